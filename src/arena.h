@@ -0,0 +1,61 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include "headers.h"
+#include <memory_resource>
+
+
+// Per-thread monotonic arena for the short-lived strings and containers of one operation.
+// Allocations are bump-pointer from a thread-local block, spill over to the heap, and are all released at once.
+// The block is allocated on a thread's first arena, threads that never use one do not pay for it.
+class ScratchArena {
+private:
+    static constexpr size_t THREAD_BLOCK_BYTES = 64 * 1024;
+
+    bool ownsBlock;
+    std::pmr::monotonic_buffer_resource resource;
+
+public:
+    ScratchArena() : ScratchArena(claimThreadBlock()) {}
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    ~ScratchArena() {
+        resource.release();
+        if (ownsBlock) {
+            threadBlockInUse() = false;
+        }
+    }
+
+    std::pmr::memory_resource* get() {
+        return &resource;
+    }
+
+    // Drop everything allocated so far, e.g. between directories of a walk, and reuse the block
+    void release() {
+        resource.release();
+    }
+
+private:
+    // Only the outermost arena of a thread owns the thread-local block, nested arenas start on the heap
+    static bool& threadBlockInUse() {
+        thread_local bool inUse = false;
+        return inUse;
+    }
+
+    static std::byte* claimThreadBlock() {
+        thread_local std::unique_ptr<std::byte[]> block;
+        if (threadBlockInUse()) {
+            return nullptr;
+        }
+        if (!block) {
+            block = std::make_unique<std::byte[]>(THREAD_BLOCK_BYTES);
+        }
+        threadBlockInUse() = true;
+        return block.get();
+    }
+
+    explicit ScratchArena(std::byte* block) : ownsBlock(block != nullptr), resource(block, block ? THREAD_BLOCK_BYTES : 0, std::pmr::new_delete_resource()) {}
+};
+
+#endif // ARENA_H
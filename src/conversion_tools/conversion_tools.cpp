@@ -1,5 +1,6 @@
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../pipeline.h"
 
 
 static std::vector<std::string> binImgFilesCache; // Memory cached binImgFiles here
@@ -292,7 +293,7 @@ void select_and_convert_files_to_iso(const std::string& fileTypeChoice) {
 
 				if (filteredFiles.empty()) { // Check if no files match the search query
 					clearScrollBuffer(); // Clear scroll buffer
-					std::cout << "\033[1;91mNo file(s) match the search query.\033[0;1m\n"; // Inform user
+					std::cout << emptyFilterMessage("file(s)") << "\n"; // Inform user
 					std::cout << "\n\033[1;32m↵ to continue...\033[0;1m"; // Prompt user to continue
 					std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 				} else {
@@ -581,9 +582,7 @@ std::vector<std::string> findFiles(const std::vector<std::string>& paths, const
         return std::vector<std::string>();
     }
     
-    std::mutex fileCheckMutex;
-    
-    bool blacklistMdf =false;
+    bool blacklistMdf = (mode != "bin");
 
     // Vector to store file names that match the criteria
     std::set<std::string> fileNames;
@@ -599,158 +598,38 @@ std::vector<std::string> findFiles(const std::vector<std::string>& paths, const
     // Start the timer
    auto start_time = std::chrono::high_resolution_clock::now();
 
-    try {
-        // Preallocate enough space for the futures vector
-        size_t totalFiles = 0;
-        for (const auto& path : paths) {
-			try {
-				for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-					if (entry.is_regular_file()) {
-						totalFiles++;
-						std::cout << "\rTotal files processed: " << totalFiles << std::flush;
-					}
-				}
-			} catch (const std::filesystem::filesystem_error& e) {
-				std::string exception = "\033[1;91mError accessing path: " + path + " - " + e.what() + "\033[0;1m";
-				processedErrors.insert(exception);
-				uniqueInvalidPaths.insert(path);
-			}
-		}
-		
-		if (!processedErrors.empty()) {
-			std::cout << "\n\n";
-			for (const auto& processedError : processedErrors) {
-				std::cout << processedError << std::endl;
-			}
-			processedErrors.clear();
-			std::chrono::seconds duration(3);
-			std::this_thread::sleep_for(duration);
-		}
-        
-        std::vector<std::future<void>> futures;
-        futures.reserve(totalFiles);
-		
-        // Counter to track the number of ongoing tasks
-        unsigned int numOngoingTasks = 0;
-
-        // Iterate through input paths
-		for (const auto& path : paths) {
-			if (mode == "bin") {
-				// Check if the path has already been processed in "bin" mode
-				if (std::find(processedPathsBin.begin(), processedPathsBin.end(), path) != processedPathsBin.end()) {
-					continue; // Skip already processed paths
-				}
-			} else if (mode == "mdf") {
-				// Check if the path has already been processed in "mdf" mode
-				if (std::find(processedPathsMdf.begin(), processedPathsMdf.end(), path) != processedPathsMdf.end()) {
-					continue; // Skip already processed paths
-				}
-			}
+    // Files found by previous searches, read-only while the pipeline runs
+    const std::vector<std::string>& filesCache = (mode == "bin") ? binImgFilesCache : mdfMdsFilesCache;
+    const std::unordered_set<std::string> cachedFiles(filesCache.begin(), filesCache.end());
+    std::vector<std::string>& processedPaths = (mode == "bin") ? processedPathsBin : processedPathsMdf;
 
-            try {
-                // Use a lambda function to process files asynchronously
-                auto processFileAsync = [&](const std::filesystem::directory_entry& entry) {
-                    std::string fileName = entry.path().string();
-                    std::string filePath = entry.path().parent_path().string();  // Get the path of the directory
-
-                    // Call the callback function to inform about the found file
-                    callback(fileName, filePath);
-
-                    // Lock the mutex to ensure safe access to shared data (fileNames and numOngoingTasks)
-                    std::lock_guard<std::mutex> lock(mutex4search);
-
-                    // Add the file name to the shared data
-                    fileNames.insert(fileName);
-
-                    // Decrement the ongoing tasks counter
-                    --numOngoingTasks;
-                };
-
-                // Use async to process files concurrently
-                // Iterate through files in the given directory and its subdirectories
-                if (mode == "bin") {
-					blacklistMdf = false;
-                    for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-                        if (entry.is_regular_file()) {
-                            // Checks .bin .img blacklist
-                            if (blacklist(entry, blacklistMdf)) {
-                                // Check if the file is already present in the cache to avoid duplicates
-                                std::string fileName = entry.path().string();
-                                if (std::find(binImgFilesCache.begin(), binImgFilesCache.end(), fileName) == binImgFilesCache.end()) {
-                                    // Process the file asynchronously
-                                    if (numOngoingTasks < maxThreads) {
-                                        // Increment the ongoing tasks counter
-                                        ++numOngoingTasks;
-                                        std::lock_guard<std::mutex> lock(mutex4search);
-                                        // Process the file asynchronously
-                                        futures.emplace_back(std::async(std::launch::async, processFileAsync, entry));
-                                    } else {
-                                        // Wait for one of the ongoing tasks to complete before adding a new task
-                                        for (auto& future : futures) {
-                                            if (future.valid()) {
-                                                future.get();
-                                            }
-                                        }
-                                        // Increment the ongoing tasks counter
-                                        ++numOngoingTasks;
-                                        std::lock_guard<std::mutex> lock(mutex4search);
-                                        // Process the file asynchronously
-                                        futures.emplace_back(std::async(std::launch::async, processFileAsync, entry));
-                                    }
-                                }
-                            }
-                        }
-                        processedPathsBin.push_back(path);
-                    }
-                } else {                    
-                    blacklistMdf = true;
-                    
-                    // Iterate through files in the given directory and its subdirectories
-                    for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-                        if (entry.is_regular_file()) { 
-                            if (blacklist(entry, blacklistMdf)) {
-                                // Check if the file is already present in the cache to avoid duplicates
-                                std::string fileName = entry.path().string();
-                                if (std::find(mdfMdsFilesCache.begin(), mdfMdsFilesCache.end(), fileName) == mdfMdsFilesCache.end()) {
-                                    // Process the file asynchronously
-                                    if (numOngoingTasks < maxThreads) {
-                                        // Increment the ongoing tasks counter
-                                        ++numOngoingTasks;
-                                        std::lock_guard<std::mutex> lock(mutex4search);
-                                        // Process the file asynchronously
-                                        futures.emplace_back(std::async(std::launch::async, processFileAsync, entry));
-                                    } else {
-                                        // Wait for one of the ongoing tasks to complete before adding a new task
-                                        for (auto& future : futures) {
-                                            if (future.valid()) {
-                                                future.get();
-                                            }
-                                        }
-                                        // Increment the ongoing tasks counter
-                                        ++numOngoingTasks;
-                                        std::lock_guard<std::mutex> lock(mutex4search);
-                                        // Process the file asynchronously
-                                        futures.emplace_back(std::async(std::launch::async, processFileAsync, entry));
-                                    }
-                                }
-                            }
-                        }
-                    }
+    // Walk, classify and collect run as overlapping stages instead of a counting pass followed by a processing pass
+    Pipeline pipeline;
+    size_t totalFiles = 0;
 
-                    // Wait for remaining asynchronous tasks to complete
-                    for (auto& future : futures) {
-                        // Check if the future is valid
-                        if (future.valid()) {
-                            // Block until the future is ready
-                            future.get();
+    // Walk stage: list regular files below every input path
+    auto& walkedFiles = pipeline.source<std::filesystem::directory_entry>("walk", [&](PipelineEmitter<std::filesystem::directory_entry>& emit) {
+        for (const auto& path : paths) {
+            // Skip paths already processed in this mode
+            if (std::find(processedPaths.begin(), processedPaths.end(), path) != processedPaths.end()) {
+                continue;
+            }
+            try {
+                for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                    if (entry.is_regular_file()) {
+                        totalFiles++;
+                        std::cout << "\rTotal files processed: " << totalFiles << std::flush;
+                        if (!emit(entry)) {
+                            return;
                         }
                     }
-                    
-                    // Add the processed path to the set
-                    processedPathsMdf.push_back(path);
                 }
+                // Add the processed path to the list
+                processedPaths.push_back(path);
             } catch (const std::filesystem::filesystem_error& e) {
                 std::lock_guard<std::mutex> lock(mutex4search);
+                std::string exception = "\033[1;91mError accessing path: " + path + " - " + e.what() + "\033[0;1m";
+                processedErrors.insert(exception);
 
                 // Check if the exception is related to a permission error
                 const std::error_code& ec = e.code();
@@ -762,7 +641,6 @@ std::vector<std::string> findFiles(const std::vector<std::string>& paths, const
                             std::cout << "\n";
                             printedEmptyLine = true;
                         }
-                        
                     }
                 } else if (std::find(cachedInvalidPaths.begin(), cachedInvalidPaths.end(), path) == cachedInvalidPaths.end()) {
                     if (!printedEmptyLine) {
@@ -774,15 +652,46 @@ std::vector<std::string> findFiles(const std::vector<std::string>& paths, const
                 }
             }
         }
+    });
 
-    } catch (const std::filesystem::filesystem_error& e) {
-        if (!printedEmptyLine) {
-            // Print an empty line before starting to print invalid paths (only once)
-            std::cout << "\n";
-            printedEmptyLine = true;
+    // Classify stage: extension, size and keyword blacklist, then skip files cached by previous searches
+    auto& matchedFiles = pipeline.stage<std::filesystem::directory_entry, std::string>("classify", maxThreads, walkedFiles, [&](std::filesystem::directory_entry&& entry, PipelineEmitter<std::string>& emit) {
+        try {
+            // Checks .bin .img .mdf blacklist
+            if (!blacklist(entry, blacklistMdf)) {
+                return;
+            }
+        } catch (const std::filesystem::filesystem_error&) {
+            // File vanished or became unreadable after it was listed
+            return;
+        }
+        std::string fileName = entry.path().string();
+        if (cachedFiles.find(fileName) == cachedFiles.end()) {
+            emit(std::move(fileName));
+        }
+    });
+
+    // Collect stage: inform the caller and keep the new file names
+    pipeline.sink<std::string>("collect", 1, matchedFiles, [&](std::string&& fileName) {
+        std::string filePath = std::filesystem::path(fileName).parent_path().string();  // Get the path of the directory
+
+        // Call the callback function to inform about the found file
+        callback(fileName, filePath);
+
+        std::lock_guard<std::mutex> lock(mutex4search);
+        fileNames.insert(std::move(fileName));
+    });
+
+    pipeline.run();
+
+    if (!processedErrors.empty()) {
+        std::cout << "\n\n";
+        for (const auto& processedError : processedErrors) {
+            std::cout << processedError << std::endl;
         }
-        // Handle filesystem errors for the overall operation
-       // std::cerr << "\033[1;91m" << e.what() << ".\033[0;1m\n";
+        processedErrors.clear();
+        std::chrono::seconds duration(3);
+        std::this_thread::sleep_for(duration);
     }
     
 
@@ -807,6 +716,12 @@ std::vector<std::string> findFiles(const std::vector<std::string>& paths, const
         // Print the time taken for the entire process in bold with one decimal place
 		std::cout << "\033[1mTime Elapsed: " << std::fixed << std::setprecision(1) << total_elapsed_time << " seconds\033[0;1m\n";
         std::cout << "\n";
+        // Per-stage throughput for diagnosing slow searches, the slowest stage is highlighted (pipeline_report)
+        static const bool pipelineReport = configFlag("pipeline_report", false);
+        if (pipelineReport) {
+            pipeline.printReport();
+            std::cout << "\n";
+        }
         std::cout << "\033[1;32m↵ to continue...\033[0;1m";
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     }
@@ -966,20 +881,12 @@ void convertToISO(const std::string& inputPath, std::set<std::string>& successOu
         return;
     }
 
-    // Escape the inputPath before using it in shell commands
-    std::string escapedInputPath = shell_escape(inputPath);
-
-    // Escape the outputPath before using it in shell commands
-    std::string escapedOutputPath = shell_escape(outputPath);
-
-    // Determine the appropriate conversion command
-    std::string conversionCommand;
+    // Determine the appropriate conversion program, it is run directly without a shell
+    std::vector<std::string> conversionArguments;
     if (modeMdf) {
-        conversionCommand = "mdf2iso " + escapedInputPath + " " + escapedOutputPath;
-        conversionCommand += " > /dev/null 2>&1";
+        conversionArguments = {"mdf2iso", inputPath, outputPath};
     } else if (!modeMdf) {
-        conversionCommand = "ccd2iso " + escapedInputPath + " " + escapedOutputPath;
-        conversionCommand += " > /dev/null 2>&1";
+        conversionArguments = {"ccd2iso", inputPath, outputPath};
     } else {
         std::string failedMessage = "\033[1;91mUnsupported file format for \033[1;93m'" + directory + "/" + fileNameOnly + "'\033[1;91m. Conversion failed.\033[0;1m";
         {	std::lock_guard<std::mutex> lowLock(Mutex4Low);
@@ -988,8 +895,9 @@ void convertToISO(const std::string& inputPath, std::set<std::string>& successOu
         return;
     }
 
-    // Execute the conversion command
-    int conversionStatus = std::system(conversionCommand.c_str());
+    // Execute the conversion under the watchdog, a converter stuck on a corrupt image is killed
+    bool timedOut = false;
+    int conversionStatus = runWatchedProcess("convert", conversionArguments, timedOut);
 
     auto [outDirectory, outFileNameOnly] = extractDirectoryAndFilename(outputPath);
     // Check the result of the conversion
@@ -999,7 +907,9 @@ void convertToISO(const std::string& inputPath, std::set<std::string>& successOu
 			successOuts.insert(successMessage);
 		}
     } else {
-        std::string failedMessage = "\033[1;91mConversion of \033[1;93m'" + directory + "/" + fileNameOnly + "'\033[1;91m failed.\033[0;1m";
+        std::string failedMessage = timedOut
+            ? "\033[1;91mConversion of \033[1;93m'" + directory + "/" + fileNameOnly + "'\033[1;91m timed out after " + std::to_string(watchdogTimeoutSeconds("convert")) + "s and was killed.\033[0;1m"
+            : "\033[1;91mConversion of \033[1;93m'" + directory + "/" + fileNameOnly + "'\033[1;91m failed.\033[0;1m";
         {	std::lock_guard<std::mutex> lowLock(Mutex4Low);
 			failedOuts.insert(failedMessage);
 		}
@@ -0,0 +1,408 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+#include "threadpool.h"
+#include <coroutine>
+#include <exception>
+#include <map>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+
+// Coroutine tasks resumed on the ThreadPool work-stealing queues
+template <typename T = void>
+class task;
+
+// Counts down finished child coroutines, the last one resumes the waiting coroutine or wakes sync_wait()
+struct TaskLatch {
+    std::atomic<size_t> remaining;
+    std::coroutine_handle<> continuation;
+
+    // Used by sync_wait(), which has no coroutine to resume
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+
+    explicit TaskLatch(size_t count) : remaining(count) {}
+
+    std::coroutine_handle<> arrive() {
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return std::noop_coroutine();
+        }
+        if (continuation) {
+            return continuation;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        cv.notify_all();
+        return std::noop_coroutine();
+    }
+};
+
+// Promise parts shared by every task<T>
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    // Resume whoever awaited the task once it has finished
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    // Tasks are lazy, they start when awaited
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+    task<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    task<void> get_return_object();
+    void return_void() {}
+};
+
+template <typename T>
+class task {
+public:
+    using promise_type = TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    explicit task(handle_type coroutine) : handle(coroutine) {}
+    task(task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // Awaiting a task starts it and resumes the awaiting coroutine when it finishes
+    bool await_ready() const noexcept { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() {
+        if (handle.promise().exception) {
+            std::rethrow_exception(handle.promise().exception);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*handle.promise().value);
+        }
+    }
+
+private:
+    handle_type handle;
+};
+
+template <typename T>
+task<T> TaskPromise<T>::get_return_object() {
+    return task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline task<void> TaskPromise<void>::get_return_object() {
+    return task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+
+// Eagerly driven wrapper that runs one task and reports to a TaskLatch when it is done
+struct TaskLatchItem {
+    struct promise_type {
+        TaskLatch* latch = nullptr;
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                return handle.promise().latch->arrive();
+            }
+            void await_resume() noexcept {}
+        };
+
+        TaskLatchItem get_return_object() { return TaskLatchItem(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); } // Exceptions are captured inside the item body
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit TaskLatchItem(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+    TaskLatchItem(TaskLatchItem&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    TaskLatchItem(const TaskLatchItem&) = delete;
+    ~TaskLatchItem() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    void start(TaskLatch& latch) {
+        handle.promise().latch = &latch;
+        handle.resume();
+    }
+};
+
+template <typename T>
+TaskLatchItem makeTaskLatchItem(task<T>& child, std::optional<T>& result, std::exception_ptr& error) {
+    try {
+        result.emplace(co_await child);
+    } catch (...) {
+        error = std::current_exception();
+    }
+}
+
+inline TaskLatchItem makeTaskLatchItem(task<void>& child, std::exception_ptr& error) {
+    try {
+        co_await child;
+    } catch (...) {
+        error = std::current_exception();
+    }
+}
+
+// Starts every item and suspends until the last one has arrived at the latch
+struct WhenAllAwaiter {
+    std::vector<TaskLatchItem>& items;
+    TaskLatch latch;
+
+    explicit WhenAllAwaiter(std::vector<TaskLatchItem>& children) : items(children), latch(children.size() + 1) {}
+
+    bool await_ready() const noexcept { return items.empty(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        latch.continuation = awaiting;
+        for (auto& item : items) {
+            item.start(latch);
+        }
+        // Our own arrival, resumes immediately if every child already finished
+        return latch.arrive();
+    }
+    void await_resume() noexcept {}
+};
+
+
+// Run tasks concurrently and collect their results in order, the first failure is rethrown after all have finished
+template <typename T>
+task<std::vector<T>> when_all(std::vector<task<T>> tasks) {
+    std::vector<std::optional<T>> results(tasks.size());
+    std::vector<std::exception_ptr> errors(tasks.size());
+    std::vector<TaskLatchItem> items;
+    items.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        items.push_back(makeTaskLatchItem(tasks[i], results[i], errors[i]));
+    }
+
+    co_await WhenAllAwaiter(items);
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    std::vector<T> values;
+    values.reserve(results.size());
+    for (auto& result : results) {
+        values.push_back(std::move(*result));
+    }
+    co_return values;
+}
+
+inline task<void> when_all(std::vector<task<void>> tasks) {
+    std::vector<std::exception_ptr> errors(tasks.size());
+    std::vector<TaskLatchItem> items;
+    items.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        items.push_back(makeTaskLatchItem(tasks[i], errors[i]));
+    }
+
+    co_await WhenAllAwaiter(items);
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+
+// Block the calling (non-pool) thread until a task has finished, and return its result
+template <typename T>
+T sync_wait(task<T> work) {
+    TaskLatch latch(1);
+    std::exception_ptr error;
+    if constexpr (std::is_void_v<T>) {
+        TaskLatchItem item = makeTaskLatchItem(work, error);
+        item.start(latch);
+        std::unique_lock<std::mutex> lock(latch.mutex);
+        latch.cv.wait(lock, [&latch] { return latch.done; });
+        lock.unlock();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } else {
+        std::optional<T> result;
+        TaskLatchItem item = makeTaskLatchItem(work, result, error);
+        item.start(latch);
+        std::unique_lock<std::mutex> lock(latch.mutex);
+        latch.cv.wait(lock, [&latch] { return latch.done; });
+        lock.unlock();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*result);
+    }
+}
+
+
+// co_await schedule_on(pool) continues the coroutine on a pool worker
+struct ScheduleAwaiter {
+    ThreadPool& pool;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { pool.post([handle] { handle.resume(); }); }
+    void await_resume() noexcept {}
+};
+
+inline ScheduleAwaiter schedule_on(ThreadPool& pool) {
+    return ScheduleAwaiter{pool};
+}
+
+
+// Single timer thread that posts expired coroutines back to their pool
+class TimerService {
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers;
+    bool stop;
+    std::thread worker;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop) {
+            if (timers.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+            auto next = timers.begin();
+            if (std::chrono::steady_clock::now() < next->first) {
+                cv.wait_until(lock, next->first);
+                continue;
+            }
+            auto callback = std::move(next->second);
+            timers.erase(next);
+            lock.unlock();
+            callback();
+            lock.lock();
+        }
+    }
+
+public:
+    TimerService() : stop(false), worker(&TimerService::run, this) {}
+
+    ~TimerService() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    void schedule(std::chrono::steady_clock::time_point deadline, std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            timers.emplace(deadline, std::move(callback));
+        }
+        cv.notify_all();
+    }
+};
+
+inline TimerService& timerService() {
+    static TimerService service;
+    return service;
+}
+
+// co_await async_sleep(pool, duration) suspends without holding a worker, and resumes on the pool
+struct SleepAwaiter {
+    ThreadPool& pool;
+    std::chrono::steady_clock::time_point deadline;
+
+    bool await_ready() const noexcept { return std::chrono::steady_clock::now() >= deadline; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        ThreadPool* target = &pool;
+        timerService().schedule(deadline, [target, handle] { target->post([handle] { handle.resume(); }); });
+    }
+    void await_resume() noexcept {}
+};
+
+template <typename Rep, typename Period>
+SleepAwaiter async_sleep(ThreadPool& pool, std::chrono::duration<Rep, Period> duration) {
+    return SleepAwaiter{pool, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration)};
+}
+
+
+// co_await async_io(pool, function) runs a blocking filesystem or kernel call on the pool and resumes with its result
+template <typename F>
+struct IoAwaiter {
+    using result_type = std::invoke_result_t<F&>;
+
+    ThreadPool& pool;
+    F function;
+    std::conditional_t<std::is_void_v<result_type>, bool, std::optional<result_type>> result{};
+    std::exception_ptr error;
+
+    IoAwaiter(ThreadPool& target, F&& call) : pool(target), function(std::move(call)) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        pool.post([this, handle] {
+            try {
+                if constexpr (std::is_void_v<result_type>) {
+                    function();
+                } else {
+                    result.emplace(function());
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            handle.resume();
+        });
+    }
+    result_type await_resume() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if constexpr (!std::is_void_v<result_type>) {
+            return std::move(*result);
+        }
+    }
+};
+
+template <typename F>
+IoAwaiter<std::decay_t<F>> async_io(ThreadPool& pool, F&& function) {
+    return IoAwaiter<std::decay_t<F>>(pool, std::decay_t<F>(std::forward<F>(function)));
+}
+
+#endif // COROUTINE_H
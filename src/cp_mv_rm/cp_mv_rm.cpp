@@ -1,5 +1,6 @@
 #include "../headers.h"
 #include "../threadpool.h"
+#include <pwd.h>
 
 
 // For breaking mv&rm gracefully
@@ -37,6 +38,36 @@ bool isValidLinuxPathFormat(const std::string& path) {
 }
 
 
+// Function to split the ';' separated destination directories of cp, keeping their order and dropping repeats
+static std::vector<std::string> splitDestinationDirs(const std::string& input) {
+    std::vector<std::string> destDirs;
+    std::stringstream ss(input);
+    std::string destDir;
+    while (std::getline(ss, destDir, ';')) {
+        if (!destDir.empty() && std::find(destDirs.begin(), destDirs.end(), destDir) == destDirs.end()) {
+            destDirs.push_back(destDir);
+        }
+    }
+    return destDirs;
+}
+
+
+// Function to name the operation class of a copy or move after its destination device, so each device learns its own concurrency.
+// A destination directory that does not exist yet will be created on the device of its nearest existing parent.
+static std::string operationClassFor(bool isMove, const std::string& destDir) {
+    std::string operationClass = isMove ? "mv" : "cp";
+    std::filesystem::path existing(destDir);
+    struct stat destDirStat;
+    while (stat(existing.c_str(), &destDirStat) != 0) {
+        if (!existing.has_parent_path() || existing.parent_path() == existing) {
+            return operationClass;
+        }
+        existing = existing.parent_path();
+    }
+    return operationClass + ":" + std::to_string(destDirStat.st_dev);
+}
+
+
 // Main function to select and operate on files by number
 void select_and_operate_files_by_number(const std::string& operation) {
 	
@@ -50,6 +81,7 @@ void select_and_operate_files_by_number(const std::string& operation) {
     // Load ISO files from the cache
     std::vector<std::string> isoFiles;
 	isoFiles.reserve(100);
+	CatalogGeneration catalogGeneration; // Identity of the loaded list, lets filterCatalog reuse earlier search results
 
     // Color code based on the operation
     std::string operationColor;
@@ -69,7 +101,7 @@ void select_and_operate_files_by_number(const std::string& operation) {
         // Remove non-existent paths from the cache after selection
         removeNonExistentPathsFromCache();
 		// Load ISO files from cache
-		loadCache(isoFiles);
+		loadCache(isoFiles, &catalogGeneration);
 		
 		clearScrollBuffer();
         
@@ -85,6 +117,7 @@ void select_and_operate_files_by_number(const std::string& operation) {
         // Display header message
         std::cout << "\033[1;93m! IF EXPECTED ISO FILES ARE NOT ON THE LIST IMPORT THEM FROM THE MAIN MENU OPTIONS !\033[0;1m\n";
         std::cout << "\033[92;1m                  // CHANGES ARE REFLECTED AUTOMATICALLY //\033[0;1m\n";
+        printBackgroundRefreshStatus(false);
 
         std::string searchQuery;
         std::vector<std::string> filteredFiles = isoFiles;
@@ -137,12 +170,12 @@ void select_and_operate_files_by_number(const std::string& operation) {
             if (!(std::isspace(searchQuery[0]) || searchQuery[0] == '\0')) {
 
             if (searchQuery != nullptr) {
-                std::vector<std::string> filteredFiles = filterFiles(isoFiles, searchQuery);
+                std::vector<std::string> filteredFiles = filterCatalog(isoFiles, catalogGeneration, searchQuery);
                 free(searchQuery);
 
                 if (filteredFiles.empty()) {
 					clearScrollBuffer();
-                    std::cout << "\033[1;91mNo ISO(s) match the search query.\033[0;1m\n";
+                    std::cout << emptyFilterMessage("ISO(s)") << "\n";
 					std::cout << "\n\033[1;32m↵ to continue...\033[0;1m";
 					std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
                 } else {
@@ -357,7 +390,8 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
         return;
     }
 
-    unsigned int numThreads = std::min(static_cast<int>(processedIndices.size()), static_cast<int>(maxThreads));
+    // Split the work into up to io_concurrency_max chunks, the pool below runs as many at once as the controllers allow
+    unsigned int numThreads = std::min(static_cast<int>(processedIndices.size()), static_cast<int>(ioConcurrencyMax()));
     std::vector<std::vector<int>> indexChunks;
     const size_t chunkSize = (processedIndices.size() + numThreads - 1) / numThreads;
     for (size_t i = 0; i < processedIndices.size(); i += chunkSize) {
@@ -391,8 +425,10 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
             // Load history from file
 			loadHistory();
 
-            // Ask for the destination directory
-            std::string prompt = "\n\001\033[1;94m\002Destination directory ↵ for selected ISO file(s), or ↵ to cancel:\n\001\033[0;1m\002";
+            // Ask for the destination directory, cp writes one read of each ISO to several of them
+            std::string prompt = isCopy
+                ? "\n\001\033[1;94m\002Destination directories ↵ for selected ISO file(s) (multi-path separator: \001\033[1m\002;\001\033[1;94m\002), or ↵ to cancel:\n\001\033[0;1m\002"
+                : "\n\001\033[1;94m\002Destination directory ↵ for selected ISO file(s), or ↵ to cancel:\n\001\033[0;1m\002";
             char* input = readline(prompt.c_str());
 
             // Check if the user canceled
@@ -403,20 +439,26 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
                 return;
             }
 
-            // Check if the entered path is valid
-			if (isValidLinuxPathFormat(input) && std::string(input).back() == '/') {
+            // Check if the entered paths are valid, every one of them has to be
+			std::vector<std::string> destDirs = isCopy ? splitDestinationDirs(input) : std::vector<std::string>{input};
+			bool validFormat = !destDirs.empty() && std::all_of(destDirs.begin(), destDirs.end(), isValidLinuxPathFormat);
+			bool endsWithSlash = std::all_of(destDirs.begin(), destDirs.end(), [](const std::string& destDir) { return destDir.back() == '/'; });
+			if (validFormat && endsWithSlash) {
 				userDestDir = input;
 				add_history(input);
 				saveHistory();
 				clear_history();
 				free(input);
 				break;
-			} else if (isValidLinuxPathFormat(input) && std::string(input).back() != '/') {
+			} else if (validFormat) {
 				std::cout << "\n\033[1;91mThe path must end with \033[0;1m'/'\033[1;91m.\033[0;1m\n";
 				free(input);
+			} else if (isCopy) {
+				free(input);
+				std::cout << "\n\033[1;91mInvalid paths are excluded from \033[1;92mcp\033[1;91m operations.\033[0;1m\n";
 			} else {
 				free(input);
-				std::cout << "\n\033[1;91mInvalid paths and/or multiple paths are excluded from \033[1;92mcp\033[1;91m and \033[1;93mmv\033[1;91m operations.\033[0;1m\n";
+				std::cout << "\n\033[1;91mInvalid paths and/or multiple paths are excluded from \033[1;93mmv\033[1;91m operations.\033[0;1m\n";
 			}
 
 			std::cout << "\n\033[1;32m↵ to try again...\033[0;1m";
@@ -471,7 +513,17 @@ void processOperationInput(const std::string& input, std::vector<std::string>& i
 	// Start the progress bar in a separate thread
 	std::thread progressThread(displayProgressBar, std::ref(completedTasks), std::cref(totalTasksValue), std::ref(isProcessingComplete));
 
-	ThreadPool pool(numThreads);
+	// Workers beyond the tightest in-flight limit of the operation classes involved would only block on their slots
+	size_t poolThreads = numThreads;
+	if (isDelete) {
+		poolThreads = ioPoolSize(concurrencyControllerFor("rm"), numThreads);
+	} else {
+		for (const auto& destDir : isCopy ? splitDestinationDirs(userDestDir) : std::vector<std::string>{userDestDir}) {
+			poolThreads = std::min(poolThreads, ioPoolSize(concurrencyControllerFor(operationClassFor(isMove, destDir)), numThreads));
+		}
+	}
+
+	ThreadPool pool(poolThreads);
 	std::vector<std::future<void>> futures;
 	futures.reserve(numThreads);
 
@@ -565,93 +617,126 @@ void handleIsoFileOperation(const std::vector<std::string>& isoFiles, std::vecto
         std::cerr << "\n\033[1;91mError getting current group:\033[0;1m " << strerror(errno) << "\033[0;1m";
         return;
     }
-    std::string user_str(current_user);
-    std::string group_str = std::to_string(static_cast<unsigned int>(current_group));
-
     // Vector to store ISO files to operate on
     std::vector<std::string> isoFilesToOperate;
 
-    // Lambda function to execute the operation command
-    auto executeOperation = [&](const std::vector<std::string>& files) {
-        std::string operationCommand;
+    // Owner applied to copied/moved files and created destination directories
+    struct passwd* userEntry = getpwnam(current_user);
+    uid_t current_uid = userEntry ? userEntry->pw_uid : geteuid();
+
+    // Lambda function to record the result of one ISO file
+    auto recordResult = [&](const std::string& iso, const std::string& destDir, bool success, const std::string& errorDetail) {
+        auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(iso);
+        std::string destPath = destDir + isoFilename;
         std::ostringstream oss;
-        std::string errorMessageInfo;
-
-        // Construct operation command based on operation type
-        if (isMove || isCopy) {
-            bool dirExists = directoryExists(userDestDir);
-            if (!dirExists) {
-                operationCommand = "mkdir -p " + shell_escape(userDestDir) + " && ";
-                operationCommand += "chown " + user_str + ":" + group_str + " " + shell_escape(userDestDir) + " && ";
+        if (success) {
+            if (!isDelete) {
+                oss << "\033[1m" << (isCopy ? "Copied" : "Moved") << ": \033[1;92m'"
+                    << isoDirectory << "/" << isoFilename << "'\033[0;1m to \033[1;94m'" << destPath << "'\033[0;1m";
+            } else {
+                oss << "\033[1m" << "Deleted" << ": \033[1;92m'"
+                    << isoDirectory << "/" << isoFilename << "'\033[0;1m";
             }
+            std::lock_guard<std::mutex> lowLock(Mutex4Low);
+            operationIsos.insert(oss.str());
+        } else {
+            if (!isDelete) {
+                oss << "\033[1;91mError " << (isCopy ? "copying" : "moving") << ": \033[1;93m'"
+                    << isoDirectory << "/" << isoFilename << "'\033[1;91m to '" << destDir << "'";
+            } else {
+                oss << "\033[1;91mError " << "deleting" << ": \033[1;93m'"
+                    << isoDirectory << "/" << isoFilename << "'";
+            }
+            if (!errorDetail.empty()) {
+                oss << "\033[1;91m: " << errorDetail;
+            }
+            oss << "\033[0;1m";
+            std::lock_guard<std::mutex> lowLock(Mutex4Low);
+            operationErrors.insert(oss.str());
         }
+    };
 
-        if (isMove) {
-            operationCommand += "mv ";
-        } else if (isCopy) {
-            operationCommand += "cp -f ";
-        } else if (isDelete) {
-            operationCommand = "rm -f ";
-        } else {
-            std::cerr << "Invalid operation specified.\n";
+    // Lambda function to execute the operation
+    auto executeOperation = [&](const std::vector<std::string>& files) {
+        if (files.empty()) {
             return;
         }
 
-        // Append ISO files to the operation command
-        for (const auto& operateIso : files) {
-            operationCommand += shell_escape(operateIso) + " ";
+        if (isDelete) {
+            // Renaming into the trash is instant, the space is freed later by the background reclaimer
+            // Each rename takes its own slot, so the controller gets one latency sample per file
+            ConcurrencyController& rmController = concurrencyControllerFor("rm");
+            for (const auto& iso : files) {
+                std::string errorDetail;
+                bool success;
+                {
+                    ConcurrencyController::Slot slot(rmController);
+                    success = moveToTrash(iso, errorDetail);
+                }
+                recordResult(iso, "", success, errorDetail);
+            }
+            return;
         }
 
-        // If not deleting, append destination directory
-        if (!isDelete) {
-            operationCommand += shell_escape(userDestDir) + " 2>/dev/null";
+        // Create the destination directories owned by the current user, one that cannot be created is left out
+        std::vector<std::string> destDirs;
+        for (const auto& destDir : isCopy ? splitDestinationDirs(userDestDir) : std::vector<std::string>{userDestDir}) {
+            if (!directoryExists(destDir)) {
+                std::error_code ec;
+                std::filesystem::create_directories(destDir, ec);
+                if (ec) {
+                    for (const auto& iso : files) {
+                        recordResult(iso, destDir, false, ec.message());
+                    }
+                    continue;
+                }
+                // Ownership is best effort, as it was with chown(1)
+                [[maybe_unused]] int chownResult = chown(destDir.c_str(), current_uid, current_group);
+            }
+            destDirs.push_back(destDir);
+        }
+        if (destDirs.empty()) {
+            return;
         }
 
-        // Execute the operation command
-        int result = system(operationCommand.c_str());
+        // Throughput depends on the destination device, learn its concurrency separately
+        // A fan-out copy holds a slot on every destination device, always taken in the same order
+        std::set<std::string> operationClasses;
+        for (const auto& destDir : destDirs) {
+            operationClasses.insert(operationClassFor(isMove, destDir));
+        }
+        std::vector<ConcurrencyController*> operationControllers;
+        for (const auto& operationClass : operationClasses) {
+            operationControllers.push_back(&concurrencyControllerFor(operationClass));
+        }
 
-        // Handle operation result
-        if (result == 0) {
-            // Store operation success info
-            for (const auto& iso : files) {
-                auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(iso);
-                std::string destPath = userDestDir + isoFilename;
-                oss.str("");
-                if (!isDelete) {
-                    oss << "\033[1m" << (isCopy ? "Copied" : "Moved") << ": \033[1;92m'"
-                        << isoDirectory << "/" << isoFilename << "'\033[0;1m to \033[1;94m'" << destPath << "'\033[0;1m";
-                } else {
-                    oss << "\033[1m" << "Deleted" << ": \033[1;92m'"
-                        << isoDirectory << "/" << isoFilename << "'\033[0;1m";
-                }
-                std::string operationInfo = oss.str();
-                {
-					std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                    operationIsos.insert(operationInfo);
-				}
+        // Copy or move each file natively so data can be verified on its way
+        for (const auto& iso : files) {
+            std::vector<std::unique_ptr<ConcurrencyController::Slot>> slots;
+            for (ConcurrencyController* operationController : operationControllers) {
+                slots.push_back(std::make_unique<ConcurrencyController::Slot>(*operationController));
+            }
+            auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(iso);
 
-                // Change ownership of the copied/moved file
-                if (!isDelete) {
-                    std::string chownCommand = "chown " + user_str + ":" + group_str + " " + shell_escape(destPath);
-                    system(chownCommand.c_str());
-                }
+            std::vector<std::string> destPaths;
+            for (const auto& destDir : destDirs) {
+                destPaths.push_back(destDir + isoFilename);
             }
-        } else {
-            // Store operation error info
-            for (const auto& iso : files) {
-                auto [isoDir, isoFilename] = extractDirectoryAndFilename(iso);
-                oss.str("");
-                if (!isDelete) {
-                    oss << "\033[1;91mError " << (isCopy ? "copying" : "moving") << ": \033[1;93m'"
-                        << isoDir << "/" << isoFilename << "'\033[1;91m to '" << userDestDir << "'\033[0;1m";
-                } else {
-                    oss << "\033[1;91mError " << "deleting" << ": \033[1;93m'"
-                        << isoDir << "/" << isoFilename << "'\033[0;1m";
-                }
-                errorMessageInfo = oss.str();
-                {	std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                    operationErrors.insert(errorMessageInfo);
+            std::vector<bool> results(1, false);
+            std::vector<std::string> errorDetails(1);
+
+            // Several destinations share one read of the source
+            if (destPaths.size() > 1) {
+                copyIsoFileToMany(iso, destPaths, results, errorDetails);
+            } else {
+                results[0] = isMove ? moveIsoFile(iso, destPaths[0], errorDetails[0]) : copyIsoFile(iso, destPaths[0], errorDetails[0]);
+            }
+
+            for (size_t i = 0; i < destPaths.size(); ++i) {
+                if (results[i]) {
+                    [[maybe_unused]] int chownResult = chown(destPaths[i].c_str(), current_uid, current_group);
                 }
+                recordResult(iso, destDirs[i], results[i], errorDetails[i]);
             }
         }
     };
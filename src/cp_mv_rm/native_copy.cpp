@@ -0,0 +1,1403 @@
+#include "../headers.h"
+#include "../pipeline.h"
+#include "../threadpool.h"
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#include <sys/vfs.h>
+
+// Reflink ioctl of <linux/fs.h>, whose mount definitions clash with <sys/mount.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+
+// NATIVE COPY STUFF
+
+// XXH64 primes
+const uint64_t XXH_PRIME64_1 = 11400714785074694791ULL;
+const uint64_t XXH_PRIME64_2 = 14029467366897019727ULL;
+const uint64_t XXH_PRIME64_3 = 1609587929392839161ULL;
+const uint64_t XXH_PRIME64_4 = 9650029242287828579ULL;
+const uint64_t XXH_PRIME64_5 = 2870177450012600261ULL;
+
+// Size of the user-space buffer used when data has to pass through the process
+const size_t copyBufferSize = 1024 * 1024;
+
+// Chunk size and alignment of direct I/O copies, 4 KiB covers 512 and 4096 byte sector devices
+const size_t directBufferSize = 8 * 1024 * 1024;
+const off_t directIoAlignment = 4096;
+
+// Range size and minimum data size of multi-stream copies to network filesystems
+const off_t streamRangeSize = 64 * 1024 * 1024;
+const off_t multiStreamMinimumBytes = 4 * streamRangeSize;
+
+// Block size compared when an existing destination is updated in place, copyBufferSize is a multiple of it
+const off_t deltaBlockSize = 256 * 1024;
+
+// Chunk size and per-destination queue depth of fan-out copies, a slow destination holds back the source by at most one queue
+const size_t fanOutChunkSize = 4 * 1024 * 1024;
+const size_t fanOutQueueChunks = 8;
+
+// Aligned direct I/O buffers kept for reuse across copies
+static std::mutex directBufferMutex;
+static std::vector<char*> directBufferPool;
+
+// Extended attribute holding the checksum recorded by a verified copy
+const char* const checksumAttribute = "user.isocmd.xxh64";
+
+
+static inline uint64_t xxh64Rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+
+static inline uint64_t xxh64Read64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+static inline uint32_t xxh64Read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+static inline uint64_t xxh64Round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh64Rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+
+static inline uint64_t xxh64MergeRound(uint64_t acc, uint64_t value) {
+    acc ^= xxh64Round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+
+// Function to start a new XXH64 hash
+void xxh64Reset(Xxh64State& state, uint64_t seed) {
+    state.v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    state.v[1] = seed + XXH_PRIME64_2;
+    state.v[2] = seed;
+    state.v[3] = seed - XXH_PRIME64_1;
+    state.seed = seed;
+    state.totalLength = 0;
+    state.bufferSize = 0;
+}
+
+
+// Function to feed data into an XXH64 hash
+void xxh64Update(Xxh64State& state, const void* data, size_t length) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + length;
+    state.totalLength += length;
+
+    // Not enough for a full stripe yet, keep it for later
+    if (state.bufferSize + length < 32) {
+        std::memcpy(state.buffer + state.bufferSize, p, length);
+        state.bufferSize += length;
+        return;
+    }
+
+    // Complete the stripe left over from the previous call
+    if (state.bufferSize > 0) {
+        size_t fill = 32 - state.bufferSize;
+        std::memcpy(state.buffer + state.bufferSize, p, fill);
+        for (int i = 0; i < 4; ++i) {
+            state.v[i] = xxh64Round(state.v[i], xxh64Read64(state.buffer + i * 8));
+        }
+        p += fill;
+        state.bufferSize = 0;
+    }
+
+    // Process whole 32 byte stripes straight from the input
+    while (p + 32 <= end) {
+        for (int i = 0; i < 4; ++i) {
+            state.v[i] = xxh64Round(state.v[i], xxh64Read64(p + i * 8));
+        }
+        p += 32;
+    }
+
+    state.bufferSize = static_cast<size_t>(end - p);
+    std::memcpy(state.buffer, p, state.bufferSize);
+}
+
+
+// Function to get the XXH64 value of the data hashed so far
+uint64_t xxh64Digest(const Xxh64State& state) {
+    uint64_t hash;
+    if (state.totalLength >= 32) {
+        hash = xxh64Rotl(state.v[0], 1) + xxh64Rotl(state.v[1], 7) + xxh64Rotl(state.v[2], 12) + xxh64Rotl(state.v[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            hash = xxh64MergeRound(hash, state.v[i]);
+        }
+    } else {
+        hash = state.seed + XXH_PRIME64_5;
+    }
+    hash += state.totalLength;
+
+    const unsigned char* p = state.buffer;
+    const unsigned char* const end = p + state.bufferSize;
+    while (p + 8 <= end) {
+        hash ^= xxh64Round(0, xxh64Read64(p));
+        hash = xxh64Rotl(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        hash ^= static_cast<uint64_t>(xxh64Read32(p)) * XXH_PRIME64_1;
+        hash = xxh64Rotl(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= (*p) * XXH_PRIME64_5;
+        hash = xxh64Rotl(hash, 11) * XXH_PRIME64_1;
+        ++p;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+// Function to list the data segments of a file, holes between them are not read or written
+static std::vector<std::pair<off_t, off_t>> findDataSegments(int fd, off_t size) {
+    std::vector<std::pair<off_t, off_t>> segments;
+    off_t offset = 0;
+    while (offset < size) {
+        off_t dataStart = lseek(fd, offset, SEEK_DATA);
+        if (dataStart < 0) {
+            if (errno == ENXIO) {
+                break; // Only a hole is left
+            }
+            // SEEK_DATA unsupported, treat the whole file as data
+            segments.assign(1, {0, size});
+            return segments;
+        }
+        if (dataStart >= size) {
+            break;
+        }
+        off_t holeStart = lseek(fd, dataStart, SEEK_HOLE);
+        if (holeStart < 0 || holeStart > size) {
+            holeStart = size;
+        }
+        segments.emplace_back(dataStart, holeStart);
+        offset = holeStart;
+    }
+    return segments;
+}
+
+
+// Function to reserve destination space for the data segments before anything is copied
+static bool reserveDataSegments(int destFd, const std::vector<std::pair<off_t, off_t>>& segments) {
+    for (const auto& [start, end] : segments) {
+        if (fallocate(destFd, FALLOC_FL_KEEP_SIZE, start, end - start) != 0) {
+            if (errno != EOPNOTSUPP && errno != ENOSYS) {
+                return false; // ENOSPC or EDQUOT, fail before copying a single byte
+            }
+            // No fallocate on this filesystem, check the free space instead
+            off_t dataBytes = 0;
+            for (const auto& segment : segments) {
+                dataBytes += segment.second - segment.first;
+            }
+            struct statvfs destStat;
+            if (fstatvfs(destFd, &destStat) == 0 && static_cast<unsigned long long>(destStat.f_bavail) * destStat.f_frsize < static_cast<unsigned long long>(dataBytes)) {
+                errno = ENOSPC;
+                return false;
+            }
+            return true;
+        }
+    }
+    return true;
+}
+
+
+// Function to feed the zeros of a hole into a hash
+static void hashZeros(Xxh64State& state, off_t length) {
+    static const std::vector<char> zeros(copyBufferSize, 0);
+    while (length > 0) {
+        size_t chunk = static_cast<size_t>(std::min<off_t>(length, static_cast<off_t>(zeros.size())));
+        xxh64Update(state, zeros.data(), chunk);
+        length -= static_cast<off_t>(chunk);
+    }
+}
+
+
+// Function to evict a copied range of source and destination from the page cache
+static void dropCopiedRange(int srcFd, int destFd, off_t offset, off_t length) {
+    if (length <= 0) {
+        return;
+    }
+    // Dirty pages can not be dropped, wait for their writeback first
+    sync_file_range(destFd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(destFd, offset, length, POSIX_FADV_DONTNEED);
+    posix_fadvise(srcFd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+
+// Function to take an aligned direct I/O buffer from the pool
+static char* acquireDirectBuffer() {
+    {
+        std::lock_guard<std::mutex> lock(directBufferMutex);
+        if (!directBufferPool.empty()) {
+            char* buffer = directBufferPool.back();
+            directBufferPool.pop_back();
+            return buffer;
+        }
+    }
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, directIoAlignment, directBufferSize) != 0) {
+        return nullptr;
+    }
+    return static_cast<char*>(buffer);
+}
+
+
+// Function to return a direct I/O buffer to the pool
+static void releaseDirectBuffer(char* buffer) {
+    if (buffer) {
+        std::lock_guard<std::mutex> lock(directBufferMutex);
+        directBufferPool.push_back(buffer);
+    }
+}
+
+
+// Function to write a whole direct I/O chunk, returns 0 or the errno of the failure
+static int writeDirectChunk(int destFd, const char* buffer, size_t length, off_t offset) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = pwrite(destFd, buffer + written, length - written, offset + static_cast<off_t>(written));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return 0;
+}
+
+
+// Writer thread of one direct I/O copy, it writes a chunk while the caller reads the next one into the other buffer
+class DirectChunkWriter {
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    int destFd;
+    const char* buffer = nullptr;
+    size_t length = 0;
+    off_t offset = 0;
+    bool pending = false;
+    bool stopping = false;
+    int error = 0;
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this]() { return pending || stopping; });
+            if (!pending) {
+                return;
+            }
+            lock.unlock();
+            int writeError = writeDirectChunk(destFd, buffer, length, offset);
+            lock.lock();
+            if (error == 0) {
+                error = writeError;
+            }
+            pending = false;
+            cv.notify_all();
+        }
+    }
+
+public:
+    explicit DirectChunkWriter(int fd) : destFd(fd), thread(&DirectChunkWriter::run, this) {}
+
+    ~DirectChunkWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    // Waits for the chunk in flight, returns 0 or the errno of the first failed write
+    int wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return !pending; });
+        return error;
+    }
+
+    // Hands a chunk to the writer, the previous one must have been waited for
+    void submit(const char* chunkBuffer, size_t chunkLength, off_t chunkOffset) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffer = chunkBuffer;
+            length = chunkLength;
+            offset = chunkOffset;
+            pending = true;
+        }
+        cv.notify_all();
+    }
+};
+
+
+// Function to copy one aligned segment with O_DIRECT, reading the next chunk while the writer writes the previous one
+static bool copySegmentDirect(int srcFd, off_t start, off_t end, char* const buffers[2], DirectChunkWriter& writer, Xxh64State* state) {
+    int current = 0;
+    off_t offset = start;
+    while (offset < end) {
+        size_t chunk = static_cast<size_t>(std::min<off_t>(end - offset, static_cast<off_t>(directBufferSize)));
+        ssize_t bytesRead = pread(srcFd, buffers[current], chunk, offset);
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        if (state) {
+            xxh64Update(*state, buffers[current], static_cast<size_t>(bytesRead));
+        }
+
+        // The tail past EOF is written as zeros and cut off by the final ftruncate
+        size_t writeLength = (static_cast<size_t>(bytesRead) + directIoAlignment - 1) & ~static_cast<size_t>(directIoAlignment - 1);
+        std::memset(buffers[current] + bytesRead, 0, writeLength - static_cast<size_t>(bytesRead));
+
+        // Wait for the previous write before its buffer is reused
+        int writeError = writer.wait();
+        if (writeError != 0) {
+            errno = writeError;
+            return false;
+        }
+        writer.submit(buffers[current], writeLength, offset);
+        current ^= 1;
+
+        offset += bytesRead;
+        if (static_cast<size_t>(bytesRead) < chunk) {
+            break; // Reached EOF
+        }
+    }
+
+    int writeError = writer.wait();
+    if (writeError != 0) {
+        errno = writeError;
+        return false;
+    }
+    return true;
+}
+
+
+// Function to switch both descriptors to O_DIRECT, leaving both buffered if either filesystem refuses
+static bool enableDirectIo(int srcFd, int destFd) {
+    int srcFlags = fcntl(srcFd, F_GETFL);
+    int destFlags = fcntl(destFd, F_GETFL);
+    if (srcFlags == -1 || destFlags == -1 || fcntl(srcFd, F_SETFL, srcFlags | O_DIRECT) == -1) {
+        return false;
+    }
+    if (fcntl(destFd, F_SETFL, destFlags | O_DIRECT) == -1) {
+        fcntl(srcFd, F_SETFL, srcFlags);
+        return false;
+    }
+    return true;
+}
+
+
+// Function to round segments out to the direct I/O alignment, merging segments that then overlap
+static std::vector<std::pair<off_t, off_t>> alignSegments(const std::vector<std::pair<off_t, off_t>>& segments) {
+    std::vector<std::pair<off_t, off_t>> aligned;
+    for (const auto& [start, end] : segments) {
+        off_t alignedStart = start & ~(directIoAlignment - 1);
+        off_t alignedEnd = (end + directIoAlignment - 1) & ~(directIoAlignment - 1);
+        if (!aligned.empty() && alignedStart <= aligned.back().second) {
+            aligned.back().second = std::max(aligned.back().second, alignedEnd);
+        } else {
+            aligned.emplace_back(alignedStart, alignedEnd);
+        }
+    }
+    return aligned;
+}
+
+
+// Function to copy one segment through a user-space buffer, hashing the data on its way if requested
+static bool copySegmentThroughBuffer(int srcFd, int destFd, off_t start, off_t end, std::vector<char>& buffer, Xxh64State* state, bool dropBehind) {
+    off_t offset = start;
+    off_t dropped = start;
+    while (offset < end) {
+        size_t chunk = static_cast<size_t>(std::min<off_t>(end - offset, static_cast<off_t>(buffer.size())));
+        ssize_t bytesRead = pread(srcFd, buffer.data(), chunk, offset);
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytesRead == 0) {
+            return true; // Source shrank while copying
+        }
+        if (state) {
+            xxh64Update(*state, buffer.data(), static_cast<size_t>(bytesRead));
+        }
+        for (ssize_t written = 0; written < bytesRead; ) {
+            ssize_t result = pwrite(destFd, buffer.data() + written, static_cast<size_t>(bytesRead - written), offset + written);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += result;
+        }
+
+        // Start writeback of this chunk, then drop the previous one from the page cache once it is on disk
+        if (dropBehind) {
+            sync_file_range(destFd, offset, bytesRead, SYNC_FILE_RANGE_WRITE);
+            dropCopiedRange(srcFd, destFd, dropped, offset - dropped);
+            dropped = offset;
+        }
+        offset += bytesRead;
+    }
+    if (dropBehind) {
+        dropCopiedRange(srcFd, destFd, dropped, offset - dropped);
+    }
+    return true;
+}
+
+
+// Function to copy one segment in the kernel with copy_file_range, inKernel is cleared where it is unsupported
+static bool copySegmentInKernel(int srcFd, int destFd, off_t start, off_t end, bool& inKernel) {
+    loff_t srcOffset = start;
+    loff_t destOffset = start;
+    while (srcOffset < end) {
+        ssize_t result = copy_file_range(srcFd, &srcOffset, destFd, &destOffset, static_cast<size_t>(end - srcOffset), 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nothing written yet and the filesystems can not do it, the caller copies through user space instead
+            if (srcOffset == start && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                inKernel = false;
+            }
+            return false;
+        }
+        if (result == 0) {
+            break; // Source shrank while copying
+        }
+    }
+    return true;
+}
+
+
+// Function to pick the number of concurrent streams for copies to a destination, one stream of a network
+// filesystem is capped by the round trip of its connection rather than by the link (copy_network_streams)
+static int copyStreamsForDestination(int destFd) {
+    struct statfs destFs;
+    if (fstatfs(destFd, &destFs) != 0) {
+        return 1;
+    }
+    switch (static_cast<unsigned long>(destFs.f_type)) {
+        case 0x6969:        // NFS
+        case 0xFF534D42:    // CIFS
+        case 0xFE534D42:    // SMB2
+        case 0x517B:        // SMB
+        case 0x00C36400:    // Ceph
+        case 0x01021997:    // 9p
+        case 0x65735546:    // FUSE, e.g. sshfs
+            break;
+        default:
+            return 1;       // Local filesystems stream best sequentially
+    }
+    static const long networkStreams = configNumber("copy_network_streams", 8);
+    return static_cast<int>(std::clamp(networkStreams, 1L, 64L));
+}
+
+
+// Function to split data segments into ranges of at most streamRangeSize
+static std::vector<std::pair<off_t, off_t>> splitIntoRanges(const std::vector<std::pair<off_t, off_t>>& segments) {
+    std::vector<std::pair<off_t, off_t>> ranges;
+    for (const auto& [start, end] : segments) {
+        for (off_t offset = start; offset < end; offset += streamRangeSize) {
+            ranges.emplace_back(offset, std::min(end, offset + streamRangeSize));
+        }
+    }
+    return ranges;
+}
+
+
+// Hashes a verified copy took of its source while reading it, streams of a multi-stream copy hash each range on its own
+struct CopyHashes {
+    Xxh64State whole;                               // Whole file, for copies that read the source in order
+    std::vector<std::pair<off_t, off_t>> ranges;    // Ranges of a multi-stream copy, empty otherwise
+    std::vector<uint64_t> rangeHashes;              // XXH64 of each of those ranges
+};
+
+
+// Function to copy ranges on up to streams streams at once with positioned I/O, each stream takes the next unclaimed range.
+// With rangeHashes every range is hashed while it passes through its stream's buffer.
+static bool copyRangesMultiStream(int srcFd, int destFd, const std::vector<std::pair<off_t, off_t>>& ranges, int streams, bool dropBehind, std::vector<uint64_t>* rangeHashes) {
+    std::atomic<size_t> nextRange(0);
+    std::atomic<bool> failed(false);
+    std::atomic<int> firstError(0);
+
+    auto fail = [&failed, &firstError]() {
+        int expected = 0;
+        firstError.compare_exchange_strong(expected, errno != 0 ? errno : EIO);
+        failed.store(true);
+    };
+
+    auto stream = [&]() {
+        std::vector<char> buffer;
+        bool inKernel = !dropBehind && rangeHashes == nullptr;
+        Xxh64State rangeState;
+        while (!failed.load(std::memory_order_relaxed)) {
+            const size_t index = nextRange.fetch_add(1);
+            if (index >= ranges.size()) {
+                return;
+            }
+            const auto& [start, end] = ranges[index];
+            if (inKernel && copySegmentInKernel(srcFd, destFd, start, end, inKernel)) {
+                continue;
+            }
+            if (inKernel) {
+                fail();
+                return;
+            }
+            if (buffer.empty()) {
+                buffer.resize(copyBufferSize);
+            }
+            if (rangeHashes) {
+                xxh64Reset(rangeState, 0);
+            }
+            if (!copySegmentThroughBuffer(srcFd, destFd, start, end, buffer, rangeHashes ? &rangeState : nullptr, dropBehind)) {
+                fail();
+                return;
+            }
+            if (rangeHashes) {
+                (*rangeHashes)[index] = xxh64Digest(rangeState);
+            }
+        }
+    };
+
+    // The calling thread is the first stream, every further one needs a free slot of the process-wide stream controller,
+    // so concurrent copies share the streams instead of each starting copy_network_streams threads of its own
+    ConcurrencyController& streamController = concurrencyControllerFor("copy_stream");
+    std::vector<std::future<void>> futures;
+    for (int i = 1; i < streams && streamController.tryAcquire(); ++i) {
+        futures.push_back(std::async(std::launch::async, [&stream, &streamController]() {
+            ConcurrencyController::Slot slot(streamController, std::adopt_lock);
+            stream();
+        }));
+    }
+    stream();
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    if (failed.load()) {
+        errno = firstError.load();
+        return false;
+    }
+    return true;
+}
+
+
+// Function to copy the data segments of a file with O_DIRECT, one writer thread and one pair of buffers serve the whole copy
+static bool copyDataSegmentsDirect(int srcFd, int destFd, off_t size, const std::vector<std::pair<off_t, off_t>>& segments, Xxh64State* state) {
+    char* buffers[2] = {acquireDirectBuffer(), acquireDirectBuffer()};
+    bool success = buffers[0] && buffers[1];
+    if (!success) {
+        errno = ENOMEM;
+    }
+
+    int copyError = errno;
+    if (success) {
+        DirectChunkWriter writer(destFd);
+        off_t hashed = 0;
+        for (const auto& [start, end] : alignSegments(segments)) {
+            if (state) {
+                hashZeros(*state, start - hashed);
+                hashed = std::min(end, size);
+            }
+            if (!copySegmentDirect(srcFd, start, end, buffers, writer, state)) {
+                copyError = errno;
+                success = false;
+                break;
+            }
+        }
+        if (success && state) {
+            hashZeros(*state, size - hashed);
+        }
+    }
+
+    releaseDirectBuffer(buffers[0]);
+    releaseDirectBuffer(buffers[1]);
+    if (!success) {
+        errno = copyError;
+        return false;
+    }
+
+    // A trailing hole is not written, set the size explicitly
+    return ftruncate(destFd, size) == 0;
+}
+
+
+// Function to copy the data segments of a file, leaving holes in the destination, and hash the source on the way if hashes is given
+static bool copyDataSegments(int srcFd, int destFd, off_t size, const std::vector<std::pair<off_t, off_t>>& segments, CopyHashes* hashes) {
+    // Large copies to network filesystems are split into ranges copied on several streams
+    off_t dataBytes = 0;
+    for (const auto& [start, end] : segments) {
+        dataBytes += end - start;
+    }
+    const int streams = dataBytes >= multiStreamMinimumBytes ? copyStreamsForDestination(destFd) : 1;
+
+    // Bulk copies can bypass the page cache so they do not evict the data of mounted ISOs (copy_direct_io)
+    static const bool directIo = configFlag("copy_direct_io", false);
+    const bool useDirectIo = streams == 1 && directIo && enableDirectIo(srcFd, destFd);
+    const bool dropBehind = directIo && !useDirectIo;
+
+    if (streams > 1) {
+        // The streams finish out of order, so each range gets a hash of its own instead of one running hash
+        std::vector<std::pair<off_t, off_t>> ranges = splitIntoRanges(segments);
+        if (hashes) {
+            hashes->rangeHashes.assign(ranges.size(), 0);
+        }
+        if (!copyRangesMultiStream(srcFd, destFd, ranges, streams, dropBehind, hashes ? &hashes->rangeHashes : nullptr)) {
+            return false;
+        }
+        if (hashes) {
+            hashes->ranges = std::move(ranges);
+        }
+        return ftruncate(destFd, size) == 0;
+    }
+
+    Xxh64State* state = hashes ? &hashes->whole : nullptr;
+
+    if (useDirectIo) {
+        return copyDataSegmentsDirect(srcFd, destFd, size, segments, state);
+    }
+
+    std::vector<char> buffer;
+    bool inKernel = (state == nullptr) && !directIo;
+    off_t hashed = 0;
+
+    for (const auto& [start, end] : segments) {
+        if (state) {
+            hashZeros(*state, start - hashed);
+            hashed = std::min(end, size);
+        }
+        if (inKernel && copySegmentInKernel(srcFd, destFd, start, end, inKernel)) {
+            continue;
+        }
+        if (inKernel) {
+            return false;
+        }
+        if (buffer.empty()) {
+            buffer.resize(copyBufferSize);
+        }
+        if (!copySegmentThroughBuffer(srcFd, destFd, start, end, buffer, state, dropBehind)) {
+            return false;
+        }
+    }
+    if (state) {
+        hashZeros(*state, size - hashed);
+    }
+
+    // A trailing hole is not written, set the size explicitly
+    return ftruncate(destFd, size) == 0;
+}
+
+
+// Function to hash a whole file, reading it from the device rather than the page cache where possible
+static bool hashFile(const std::string& path, uint64_t& hash) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Xxh64State state;
+    xxh64Reset(state, 0);
+    std::vector<char> buffer(copyBufferSize);
+    bool success = true;
+    while (true) {
+        ssize_t bytesRead = read(fd, buffer.data(), buffer.size());
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            success = false;
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        xxh64Update(state, buffer.data(), static_cast<size_t>(bytesRead));
+    }
+
+    // Verification reads should not evict the working set
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    hash = xxh64Digest(state);
+    return success;
+}
+
+
+// Function to read the checksum a previous verified copy recorded on a file
+static bool readRecordedChecksum(int fd, uint64_t& hash) {
+    char value[17] = {};
+    ssize_t length = fgetxattr(fd, checksumAttribute, value, sizeof(value) - 1);
+    if (length != 16) {
+        return false;
+    }
+    char* end = nullptr;
+    hash = std::strtoull(value, &end, 16);
+    return end == value + 16;
+}
+
+
+// Function to check the source against the checksum a previous verified copy recorded on it
+static bool matchesRecordedChecksum(int srcFd, uint64_t sourceHash, std::string& errorDetail) {
+    uint64_t recordedHash;
+    if (readRecordedChecksum(srcFd, recordedHash) && recordedHash != sourceHash) {
+        // The source no longer matches the checksum recorded when it was copied here
+        errorDetail = "source does not match its recorded checksum";
+        return false;
+    }
+    return true;
+}
+
+
+// Function to record the checksum of a verified copy, so later copies of this file can be checked against it
+static void recordChecksum(int destFd, uint64_t hash) {
+    char value[17];
+    snprintf(value, sizeof(value), "%016llx", static_cast<unsigned long long>(hash));
+    fsetxattr(destFd, checksumAttribute, value, 16, 0);
+}
+
+
+// Function to check a finished copy against the hash its source data had while it was read, and record the checksum on it
+static bool verifyCopy(int srcFd, int destFd, const std::string& destPath, uint64_t sourceHash, std::string& errorDetail) {
+    uint64_t destHash;
+
+    if (!matchesRecordedChecksum(srcFd, sourceHash, errorDetail)) {
+        return false;
+    }
+    if (fsync(destFd) != 0) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+
+    // Drop the freshly written pages so the comparison reads what actually reached the device
+    posix_fadvise(destFd, 0, 0, POSIX_FADV_DONTNEED);
+    if (!hashFile(destPath, destHash)) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+    if (destHash != sourceHash) {
+        errorDetail = "verification failed, destination differs from source";
+        return false;
+    }
+
+    recordChecksum(destFd, sourceHash);
+    return true;
+}
+
+
+// Function to feed a range of a file into the whole-file hash and, if given, into the hash of that range
+static bool hashFileRange(int fd, off_t start, off_t end, std::vector<char>& buffer, Xxh64State& wholeState, Xxh64State* rangeState) {
+    for (off_t offset = start; offset < end; ) {
+        ssize_t bytesRead = pread(fd, buffer.data(), static_cast<size_t>(std::min<off_t>(end - offset, static_cast<off_t>(buffer.size()))), offset);
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytesRead == 0) {
+            break; // File is shorter, the hashes will not match
+        }
+        xxh64Update(wholeState, buffer.data(), static_cast<size_t>(bytesRead));
+        if (rangeState) {
+            xxh64Update(*rangeState, buffer.data(), static_cast<size_t>(bytesRead));
+        }
+        offset += bytesRead;
+    }
+    return true;
+}
+
+
+// Function to check a multi-stream copy range by range against the hashes its streams took of the source, and record the checksum on it.
+// The destination is read once for the range hashes and the whole-file checksum, which equals the source's once every range matches.
+static bool verifyCopyRanges(int srcFd, int destFd, const std::string& destPath, off_t size, const CopyHashes& hashes, std::string& errorDetail) {
+    if (fsync(destFd) != 0) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+
+    // Drop the freshly written pages so the comparison reads what actually reached the device
+    posix_fadvise(destFd, 0, 0, POSIX_FADV_DONTNEED);
+    int fd = open(destPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Xxh64State wholeState;
+    xxh64Reset(wholeState, 0);
+    std::vector<char> buffer(copyBufferSize);
+    bool success = true;
+    off_t offset = 0;
+    for (size_t i = 0; success && i <= hashes.ranges.size(); ++i) {
+        // Holes between the ranges, and after the last one, only count towards the whole-file checksum
+        const off_t gapEnd = i < hashes.ranges.size() ? hashes.ranges[i].first : size;
+        if (!hashFileRange(fd, offset, gapEnd, buffer, wholeState, nullptr)) {
+            errorDetail = strerror(errno);
+            success = false;
+            break;
+        }
+        if (i == hashes.ranges.size()) {
+            break;
+        }
+
+        Xxh64State rangeState;
+        xxh64Reset(rangeState, 0);
+        const auto& [start, end] = hashes.ranges[i];
+        if (!hashFileRange(fd, start, end, buffer, wholeState, &rangeState)) {
+            errorDetail = strerror(errno);
+            success = false;
+        } else if (xxh64Digest(rangeState) != hashes.rangeHashes[i]) {
+            errorDetail = "verification failed, destination differs from source";
+            success = false;
+        }
+        offset = end;
+    }
+
+    // Verification reads should not evict the working set
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    const uint64_t hash = xxh64Digest(wholeState);
+    if (!success || !matchesRecordedChecksum(srcFd, hash, errorDetail)) {
+        return false;
+    }
+    recordChecksum(destFd, hash);
+    return true;
+}
+
+
+// Function to hash a file block by block, optionally feeding the whole content into a second hash on the way
+static bool hashBlocks(int fd, off_t size, std::vector<uint64_t>& hashes, Xxh64State* wholeState) {
+    hashes.clear();
+    hashes.reserve(static_cast<size_t>((size + deltaBlockSize - 1) / deltaBlockSize));
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<char> buffer(copyBufferSize);
+    for (off_t offset = 0; offset < size; ) {
+        size_t wanted = static_cast<size_t>(std::min<off_t>(size - offset, static_cast<off_t>(buffer.size())));
+        size_t filled = 0;
+        while (filled < wanted) {
+            ssize_t bytesRead = pread(fd, buffer.data() + filled, wanted - filled, offset + static_cast<off_t>(filled));
+            if (bytesRead < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (bytesRead == 0) {
+                break; // File shrank while hashing
+            }
+            filled += static_cast<size_t>(bytesRead);
+        }
+
+        for (size_t position = 0; position < filled; position += static_cast<size_t>(deltaBlockSize)) {
+            Xxh64State blockState;
+            xxh64Reset(blockState, 0);
+            xxh64Update(blockState, buffer.data() + position, std::min(filled - position, static_cast<size_t>(deltaBlockSize)));
+            hashes.push_back(xxh64Digest(blockState));
+        }
+        if (wholeState) {
+            xxh64Update(*wholeState, buffer.data(), filled);
+        }
+        if (filled < wanted) {
+            break;
+        }
+        offset += static_cast<off_t>(filled);
+    }
+    return true;
+}
+
+
+// Function to bring a copy of the previous destination up to date by rewriting only the blocks that differ from the source (copy_delta).
+// Both files are hashed block by block in parallel first, so a large difference is known before anything is written.
+// On false, fullCopy tells whether the caller should copy the whole file instead of reporting errno.
+static bool updateDestinationDelta(int srcFd, off_t srcSize, int destFd, off_t destSize, Xxh64State* state, bool& fullCopy) {
+    static const long maxChangedPercent = std::clamp(configNumber("copy_delta_max_percent", 50), 0L, 100L);
+    static const bool directIo = configFlag("copy_direct_io", false);
+    fullCopy = false;
+
+    // The destination is hashed on its own thread while the source is hashed here
+    std::vector<uint64_t> destHashes;
+    int destError = 0;
+    std::future<bool> destHashing = std::async(std::launch::async, [&]() {
+        bool hashed = hashBlocks(destFd, destSize, destHashes, nullptr);
+        destError = errno;
+        return hashed;
+    });
+    std::vector<uint64_t> srcHashes;
+    bool srcHashed = hashBlocks(srcFd, srcSize, srcHashes, state);
+    int srcError = errno;
+    bool destHashed = destHashing.get();
+
+    if (!srcHashed) {
+        errno = srcError;
+        return false;
+    }
+    if (!destHashed) {
+        // An unreadable destination is simply replaced
+        fullCopy = true;
+        errno = destError;
+        return false;
+    }
+    if (directIo) {
+        posix_fadvise(destFd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    // Coalesce differing blocks into ranges, blocks past the end of the old destination always differ
+    std::vector<std::pair<off_t, off_t>> ranges;
+    off_t changedBytes = 0;
+    for (size_t block = 0; block < srcHashes.size(); ++block) {
+        if (block < destHashes.size() && srcHashes[block] == destHashes[block]) {
+            continue;
+        }
+        off_t start = static_cast<off_t>(block) * deltaBlockSize;
+        off_t end = std::min(start + deltaBlockSize, srcSize);
+        changedBytes += end - start;
+        if (!ranges.empty() && ranges.back().second == start) {
+            ranges.back().second = end;
+        } else {
+            ranges.emplace_back(start, end);
+        }
+    }
+    if (changedBytes * 100 > srcSize * maxChangedPercent) {
+        fullCopy = true;
+        return false;
+    }
+
+    // Growth of the file is reserved like a fresh copy, so running out of space fails before any block is rewritten
+    if (srcSize > destSize && !reserveDataSegments(destFd, {{destSize, srcSize}})) {
+        return false;
+    }
+
+    if (ranges.empty() && srcSize == destSize) {
+        return true;
+    }
+
+    std::vector<char> buffer(copyBufferSize);
+    for (const auto& [start, end] : ranges) {
+        if (!copySegmentThroughBuffer(srcFd, destFd, start, end, buffer, nullptr, directIo)) {
+            return false;
+        }
+    }
+    return ftruncate(destFd, srcSize) == 0;
+}
+
+
+// Function to fill a new file with the contents of another on the same filesystem, sharing extents where reflinks are supported
+static bool cloneFileContents(int srcFd, int destFd, off_t size) {
+    if (ioctl(destFd, FICLONE, srcFd) == 0) {
+        return true;
+    }
+    bool inKernel = true;
+    if (copySegmentInKernel(srcFd, destFd, 0, size, inKernel)) {
+        return true;
+    }
+    if (inKernel) {
+        return false;
+    }
+    std::vector<char> buffer(copyBufferSize);
+    return copySegmentThroughBuffer(srcFd, destFd, 0, size, buffer, nullptr, false);
+}
+
+
+// Function to copy one ISO file natively, optionally verifying the destination (copy_verify)
+// The copy is written to a temporary file renamed over the destination once complete, so a failure never destroys a previous copy
+bool copyIsoFile(const std::string& srcPath, const std::string& destPath, std::string& errorDetail) {
+    static const bool verify = configFlag("copy_verify", false);
+    static const bool delta = configFlag("copy_delta", false);
+
+    int srcFd = open(srcPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (srcFd == -1) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+
+    struct stat srcStat;
+    if (fstat(srcFd, &srcStat) == -1) {
+        errorDetail = strerror(errno);
+        close(srcFd);
+        return false;
+    }
+
+    // Truncating the destination would destroy the source
+    struct stat destStat;
+    bool destExists = stat(destPath.c_str(), &destStat) == 0;
+    if (destExists && destStat.st_dev == srcStat.st_dev && destStat.st_ino == srcStat.st_ino) {
+        errorDetail = "source and destination are the same file";
+        close(srcFd);
+        return false;
+    }
+
+    const std::string tempPath = destPath + ".tmp" + std::to_string(getpid());
+    CopyHashes hashes;
+    bool success = true;
+    bool fullCopy = true;
+    int destFd = -1;
+
+    // A previous copy is cloned and the clone updated when only a small part of the source changed since
+    if (delta && destExists && S_ISREG(destStat.st_mode) && destStat.st_size > 0) {
+        int previousFd = open(destPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (previousFd != -1) {
+            destFd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, srcStat.st_mode & 0777);
+            if (destFd != -1 && !cloneFileContents(previousFd, destFd, destStat.st_size)) {
+                close(destFd);
+                destFd = -1;
+                unlink(tempPath.c_str());
+            }
+            close(previousFd);
+        }
+        if (destFd != -1) {
+            if (verify) {
+                xxh64Reset(hashes.whole, 0);
+            }
+            success = updateDestinationDelta(srcFd, srcStat.st_size, destFd, destStat.st_size, verify ? &hashes.whole : nullptr, fullCopy);
+            if (fullCopy) {
+                close(destFd);
+                destFd = -1;
+                success = true;
+            } else if (!success) {
+                errorDetail = strerror(errno);
+            }
+        }
+    }
+
+    if (fullCopy) {
+        destFd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, srcStat.st_mode & 0777);
+        if (destFd == -1) {
+            errorDetail = strerror(errno);
+            close(srcFd);
+            return false;
+        }
+        posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        // Walk only the data segments so holes stay holes, and reserve their space up front
+        std::vector<std::pair<off_t, off_t>> segments = findDataSegments(srcFd, srcStat.st_size);
+        success = reserveDataSegments(destFd, segments);
+
+        if (success) {
+            if (verify) {
+                // Hash the data while it streams through the copy buffers, so the source is read only once
+                xxh64Reset(hashes.whole, 0);
+            }
+            success = copyDataSegments(srcFd, destFd, srcStat.st_size, segments, verify ? &hashes : nullptr);
+        }
+        if (!success) {
+            errorDetail = strerror(errno);
+        }
+    }
+
+    if (success && verify) {
+        success = hashes.ranges.empty() ? verifyCopy(srcFd, destFd, tempPath, xxh64Digest(hashes.whole), errorDetail)
+                                        : verifyCopyRanges(srcFd, destFd, tempPath, srcStat.st_size, hashes, errorDetail);
+    }
+
+    close(srcFd);
+    if (close(destFd) != 0 && success) {
+        errorDetail = strerror(errno);
+        success = false;
+    }
+
+    if (success && rename(tempPath.c_str(), destPath.c_str()) != 0) {
+        errorDetail = strerror(errno);
+        success = false;
+    }
+
+    // Do not leave a partial or unverified copy behind, the previous destination is still in place
+    if (!success) {
+        unlink(tempPath.c_str());
+    }
+    return success;
+}
+
+
+// Piece of source data on its way to every destination of a fan-out copy, shared until the last one has written it
+struct FanOutChunk {
+    std::shared_ptr<std::vector<char>> data;
+    off_t offset = 0;
+    size_t length = 0;
+};
+
+// One destination of a fan-out copy, fed through its own bounded queue by the single reader
+struct FanOutTarget {
+    std::string path;
+    std::string tempPath;                   // Written instead of path and renamed over it once complete
+    int fd = -1;
+    std::atomic<bool> cancelled{false};     // Set by the writer when this destination fails, or by the reader when the source does
+    int error = 0;
+    std::unique_ptr<PipelineChannel<FanOutChunk>> channel;
+};
+
+// Chunk buffers returned by the last destination that wrote them, reused for the next reads
+struct FanOutBuffers {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<std::vector<char>>> free;
+};
+
+
+static std::shared_ptr<std::vector<char>> acquireFanOutBuffer(const std::shared_ptr<FanOutBuffers>& buffers) {
+    std::unique_ptr<std::vector<char>> buffer;
+    {
+        std::lock_guard<std::mutex> lock(buffers->mutex);
+        if (!buffers->free.empty()) {
+            buffer = std::move(buffers->free.back());
+            buffers->free.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer = std::make_unique<std::vector<char>>(fanOutChunkSize);
+    }
+    return std::shared_ptr<std::vector<char>>(buffer.release(), [buffers](std::vector<char>* released) {
+        std::lock_guard<std::mutex> lock(buffers->mutex);
+        buffers->free.emplace_back(released);
+    });
+}
+
+
+// Function to write a whole buffer at an offset
+static bool writeFully(int fd, const char* data, size_t length, off_t offset) {
+    for (size_t written = 0; written < length; ) {
+        ssize_t result = pwrite(fd, data + written, length - written, offset + static_cast<off_t>(written));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+
+// Function to copy one ISO file to several destinations reading the source once: a single reader hands shared
+// chunks to one writer per destination, each behind a bounded queue. A failing destination drops out without
+// stopping the others. Each destination is written to a temporary file renamed over it once complete, so a
+// failure never destroys an existing destination. results and errorDetails receive one entry per destination.
+// Unlike copyIsoFile there is no delta update, O_DIRECT or multi-stream mode, the single read feeds plain writes.
+void copyIsoFileToMany(const std::string& srcPath, const std::vector<std::string>& destPaths, std::vector<bool>& results, std::vector<std::string>& errorDetails) {
+    static const bool verify = configFlag("copy_verify", false);
+    static const bool directIo = configFlag("copy_direct_io", false);
+
+    results.assign(destPaths.size(), false);
+    errorDetails.assign(destPaths.size(), std::string());
+
+    int srcFd = open(srcPath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat srcStat;
+    if (srcFd == -1 || fstat(srcFd, &srcStat) == -1) {
+        std::fill(errorDetails.begin(), errorDetails.end(), std::string(strerror(errno)));
+        if (srcFd != -1) {
+            close(srcFd);
+        }
+        return;
+    }
+    posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    const std::vector<std::pair<off_t, off_t>> segments = findDataSegments(srcFd, srcStat.st_size);
+
+    // Create and reserve a temporary file next to every destination, one that fails here is left out of the copy
+    std::atomic<bool> readerFailed(false);
+    std::vector<std::unique_ptr<FanOutTarget>> targets;
+    for (size_t i = 0; i < destPaths.size(); ++i) {
+        auto target = std::make_unique<FanOutTarget>();
+        target->path = destPaths[i];
+        target->tempPath = destPaths[i] + ".tmp" + std::to_string(getpid());
+        struct stat destStat;
+        if (stat(destPaths[i].c_str(), &destStat) == 0 && destStat.st_dev == srcStat.st_dev && destStat.st_ino == srcStat.st_ino) {
+            errorDetails[i] = "source and destination are the same file";
+        } else if ((target->fd = open(target->tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, srcStat.st_mode & 0777)) == -1) {
+            errorDetails[i] = strerror(errno);
+        } else if (!reserveDataSegments(target->fd, segments)) {
+            errorDetails[i] = strerror(errno);
+            close(target->fd);
+            target->fd = -1;
+            unlink(target->tempPath.c_str());
+        }
+        target->channel = std::make_unique<PipelineChannel<FanOutChunk>>(fanOutQueueChunks, 1, target->cancelled);
+        targets.push_back(std::move(target));
+    }
+
+    // One writer per destination, it stops at the end of the stream or when its destination fails
+    std::vector<std::future<void>> writers;
+    for (auto& target : targets) {
+        if (target->fd == -1) {
+            continue;
+        }
+        writers.push_back(std::async(std::launch::async, [&target = *target, srcFd]() {
+            std::atomic<int64_t> starvedNs(0);
+            FanOutChunk chunk;
+            while (target.channel->pop(chunk, starvedNs)) {
+                if (!writeFully(target.fd, chunk.data->data(), chunk.length, chunk.offset)) {
+                    target.error = errno;
+                    target.cancelled.store(true);
+                    return;
+                }
+                if (directIo) {
+                    dropCopiedRange(srcFd, target.fd, chunk.offset, static_cast<off_t>(chunk.length));
+                }
+                chunk = FanOutChunk();
+            }
+        }));
+    }
+
+    // The reader streams the data segments once, hashing them on the way for copy_verify
+    auto buffers = std::make_shared<FanOutBuffers>();
+    Xxh64State state;
+    xxh64Reset(state, 0);
+    off_t hashed = 0;
+    int readError = 0;
+    bool anyTarget = !writers.empty();
+
+    for (const auto& [start, end] : segments) {
+        if (!anyTarget || readError != 0) {
+            break;
+        }
+        if (verify) {
+            hashZeros(state, start - hashed);
+            hashed = std::min(end, srcStat.st_size);
+        }
+        for (off_t offset = start; offset < end && anyTarget; ) {
+            FanOutChunk chunk;
+            chunk.data = acquireFanOutBuffer(buffers);
+            chunk.offset = offset;
+            ssize_t bytesRead = pread(srcFd, chunk.data->data(), static_cast<size_t>(std::min<off_t>(end - offset, static_cast<off_t>(fanOutChunkSize))), offset);
+            if (bytesRead < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                readError = errno;
+                break;
+            }
+            if (bytesRead == 0) {
+                break; // Source shrank while copying
+            }
+            chunk.length = static_cast<size_t>(bytesRead);
+            if (verify) {
+                xxh64Update(state, chunk.data->data(), chunk.length);
+            }
+
+            // Blocks while a destination's queue is full, so the slowest live destination sets the pace
+            anyTarget = false;
+            for (auto& target : targets) {
+                if (target->fd == -1 || target->cancelled.load()) {
+                    continue;
+                }
+                int64_t blockedNs = 0;
+                if (target->channel->push(chunk, blockedNs)) {
+                    anyTarget = true;
+                }
+            }
+            offset += bytesRead;
+        }
+    }
+    if (verify) {
+        hashZeros(state, srcStat.st_size - hashed);
+    }
+
+    if (readError != 0) {
+        readerFailed.store(true);
+        for (auto& target : targets) {
+            target->cancelled.store(true);
+        }
+    }
+    for (auto& target : targets) {
+        target->channel->producerFinished();
+    }
+    for (auto& writer : writers) {
+        writer.get();
+    }
+
+    // Finish each destination on its own: size, verification, then the rename over the destination
+    for (size_t i = 0; i < targets.size(); ++i) {
+        FanOutTarget& target = *targets[i];
+        if (target.fd == -1) {
+            continue;
+        }
+        bool success = true;
+        if (readerFailed.load()) {
+            errorDetails[i] = strerror(readError);
+            success = false;
+        } else if (target.cancelled.load()) {
+            errorDetails[i] = strerror(target.error);
+            success = false;
+        } else if (ftruncate(target.fd, srcStat.st_size) != 0) {
+            errorDetails[i] = strerror(errno);
+            success = false;
+        } else if (verify) {
+            success = verifyCopy(srcFd, target.fd, target.tempPath, xxh64Digest(state), errorDetails[i]);
+        }
+        if (close(target.fd) != 0 && success) {
+            errorDetails[i] = strerror(errno);
+            success = false;
+        }
+        if (success && rename(target.tempPath.c_str(), target.path.c_str()) != 0) {
+            errorDetails[i] = strerror(errno);
+            success = false;
+        }
+        if (!success) {
+            unlink(target.tempPath.c_str());
+        }
+        results[i] = success;
+    }
+    close(srcFd);
+}
+
+
+// Function to move one ISO file natively, copying across filesystems
+bool moveIsoFile(const std::string& srcPath, const std::string& destPath, std::string& errorDetail) {
+    struct stat srcStat;
+    struct stat destStat;
+    if (stat(srcPath.c_str(), &srcStat) == 0 && stat(destPath.c_str(), &destStat) == 0 &&
+        srcStat.st_dev == destStat.st_dev && srcStat.st_ino == destStat.st_ino) {
+        errorDetail = "source and destination are the same file";
+        return false;
+    }
+
+    if (rename(srcPath.c_str(), destPath.c_str()) == 0) {
+        return true;
+    }
+    if (errno != EXDEV) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+
+    // Different filesystem, remove the source only once the copy is complete
+    if (!copyIsoFile(srcPath, destPath, errorDetail)) {
+        return false;
+    }
+    if (unlink(srcPath.c_str()) != 0) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+    return true;
+}
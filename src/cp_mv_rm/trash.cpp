@@ -0,0 +1,326 @@
+#include "../headers.h"
+#include <sys/xattr.h>
+
+
+// TRASH STUFF
+
+// Deleted ISOs are renamed into a trash directory on their own filesystem, a background reclaimer frees their space later
+const std::string trashDirectoryName = ".isocmd-trash";
+const std::string trashRegistryPath = std::string(std::getenv("HOME")) + "/.cache/iso_commander_trash.txt"; // Trash directories with entries left
+const char* const trashOriginAttribute = "user.isocmd.origin";
+
+// Size freed per truncation step when a trashed file is reclaimed, so a large ISO does not hold the disk for seconds at once
+const off_t trashReclaimStep = 256 * 1024 * 1024;
+
+// Guards the registry and the creation and removal of trash directories
+static std::mutex trashMutex;
+static std::condition_variable trashCv;
+static std::set<std::string> trashDirectories;
+static bool trashRegistryLoaded = false;
+static uint64_t trashEntryCounter = 0;
+
+// Reclaimer state, the thread is detached and reports when it stopped
+static bool reclaimerRunning = false;
+static bool reclaimerStop = false;
+static bool reclaimerWake = false;
+
+
+// Function to read the trash directories a previous session left entries in, trashMutex must be held
+static void loadTrashRegistry() {
+    if (trashRegistryLoaded) {
+        return;
+    }
+    trashRegistryLoaded = true;
+
+    std::ifstream file(trashRegistryPath);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[0] == '/') {
+            trashDirectories.insert(line);
+        }
+    }
+}
+
+
+// Function to save the trash directories through a temporary file and rename, trashMutex must be held
+static void saveTrashRegistry() {
+    if (trashDirectories.empty()) {
+        unlink(trashRegistryPath.c_str());
+        return;
+    }
+
+    const std::string tempPath = trashRegistryPath + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(tempPath, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) {
+            return;
+        }
+        for (const std::string& trashDirectory : trashDirectories) {
+            file << trashDirectory << "\n";
+        }
+        file.flush();
+        if (!file.good()) {
+            file.close();
+            unlink(tempPath.c_str());
+            return;
+        }
+    }
+    if (rename(tempPath.c_str(), trashRegistryPath.c_str()) != 0) {
+        unlink(tempPath.c_str());
+    }
+}
+
+
+// Function to find the top directory of the filesystem holding a directory, the trash of that filesystem lives there
+static std::string filesystemTopDirectory(const std::string& directory, dev_t device) {
+    std::filesystem::path top(directory);
+    while (top.has_parent_path() && top != top.root_path()) {
+        std::filesystem::path parent = top.parent_path();
+        struct stat parentStat;
+        if (stat(parent.c_str(), &parentStat) != 0 || parentStat.st_dev != device) {
+            break;
+        }
+        top = parent;
+    }
+    return top.string();
+}
+
+
+// Function to create a trash directory, readable by its owner only since the parents of trashed files no longer protect them.
+// An existing one is used only if it is ours with no access for others, another user may have created it first.
+static bool prepareTrashDirectory(const std::string& trashDirectory, dev_t device) {
+    if (mkdir(trashDirectory.c_str(), 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    struct stat trashStat;
+    return lstat(trashDirectory.c_str(), &trashStat) == 0 && S_ISDIR(trashStat.st_mode) && trashStat.st_dev == device &&
+           trashStat.st_uid == geteuid() && (trashStat.st_mode & 077) == 0;
+}
+
+
+// Function to delete an ISO file by renaming it into the trash of its filesystem, which is instant regardless of its size.
+// Falls back to the trash next to the file (bind mounts, unwritable filesystem tops) and then to a plain unlink.
+bool moveToTrash(const std::string& path, std::string& errorDetail) {
+    static const bool useTrash = configFlag("delete_to_trash", true);
+
+    struct stat fileStat;
+    if (lstat(path.c_str(), &fileStat) != 0) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+
+    const std::filesystem::path filePath(path);
+    const std::string directory = filePath.parent_path().string();
+    const std::string fileName = filePath.filename().string();
+
+    std::vector<std::string> trashCandidates;
+    if (useTrash) {
+        trashCandidates.push_back(filesystemTopDirectory(directory, fileStat.st_dev));
+        if (trashCandidates.back() != directory) {
+            trashCandidates.push_back(directory);
+        }
+    }
+
+    for (const std::string& candidate : trashCandidates) {
+        const std::string trashDirectory = (candidate == "/" ? "" : candidate) + "/" + trashDirectoryName;
+
+        std::lock_guard<std::mutex> lock(trashMutex);
+        if (!prepareTrashDirectory(trashDirectory, fileStat.st_dev)) {
+            continue;
+        }
+
+        // Entries are named after the time they were deleted, the reclaimer keeps them for the retention period
+        std::string entryName = std::to_string(time(nullptr)) + "." + std::to_string(getpid()) + "." + std::to_string(++trashEntryCounter) + ".";
+        entryName += fileName.substr(0, NAME_MAX - entryName.size());
+        const std::string entryPath = trashDirectory + "/" + entryName;
+
+        if (renameat(AT_FDCWD, path.c_str(), AT_FDCWD, entryPath.c_str()) != 0) {
+            if (errno == EXDEV || errno == EACCES || errno == EPERM) {
+                continue;
+            }
+            errorDetail = strerror(errno);
+            return false;
+        }
+
+        // Remember where the file came from, so it can be moved back until it is reclaimed
+        lsetxattr(entryPath.c_str(), trashOriginAttribute, path.c_str(), path.size(), 0);
+
+        loadTrashRegistry();
+        if (trashDirectories.insert(trashDirectory).second) {
+            saveTrashRegistry();
+        }
+        reclaimerWake = true;
+        trashCv.notify_all();
+        return true;
+    }
+
+    // No usable trash on this filesystem, delete right away
+    if (unlink(path.c_str()) != 0) {
+        errorDetail = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+
+// Function to free the space of one trashed file and unlink it. A file nobody else has open is shrunk in steps first,
+// so the filesystem frees its extents a slice at a time instead of in one long unlink.
+static void reclaimTrashEntry(int trashFd, const std::string& entryName) {
+    int fd = openat(trashFd, entryName.c_str(), O_WRONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd != -1) {
+        struct stat entryStat;
+        // Hard links share the data, and an open file may be a mounted ISO; both keep their data and are only unlinked.
+        // A write lease is granted only when no other descriptor is open on the file, released before anything is truncated.
+        bool exclusive = fstat(fd, &entryStat) == 0 && S_ISREG(entryStat.st_mode) && entryStat.st_nlink == 1 &&
+                         fcntl(fd, F_SETLEASE, F_WRLCK) == 0;
+        if (exclusive) {
+            fcntl(fd, F_SETLEASE, F_UNLCK);
+            for (off_t size = entryStat.st_size; size > 0; ) {
+                {
+                    std::lock_guard<std::mutex> lock(trashMutex);
+                    if (reclaimerStop) {
+                        break;
+                    }
+                }
+                throttleBackgroundIo();
+                size = std::max<off_t>(0, size - trashReclaimStep);
+                if (ftruncate(fd, size) != 0) {
+                    break;
+                }
+            }
+        }
+        close(fd);
+    }
+
+    std::lock_guard<std::mutex> lock(trashMutex);
+    if (!reclaimerStop) {
+        unlinkat(trashFd, entryName.c_str(), 0);
+    }
+}
+
+
+// Function to reclaim the entries of one trash directory older than the retention period.
+// Returns false once the directory has no entries left; nextExpiry receives when the next kept entry expires.
+static bool reclaimTrashDirectory(const std::string& trashDirectory, time_t retentionSeconds, time_t& nextExpiry) {
+    int trashFd = open(trashDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (trashFd == -1) {
+        return false;
+    }
+
+    // A directory replaced by someone else since it was registered is dropped, not reclaimed
+    struct stat trashStat;
+    if (fstat(trashFd, &trashStat) != 0 || trashStat.st_uid != geteuid() || (trashStat.st_mode & 077) != 0) {
+        close(trashFd);
+        return false;
+    }
+
+    std::vector<std::string> entryNames;
+    DIR* dir = fdopendir(dup(trashFd));
+    if (dir != nullptr) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                entryNames.emplace_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+
+    const time_t now = time(nullptr);
+    size_t kept = 0;
+    for (const std::string& entryName : entryNames) {
+        {
+            std::lock_guard<std::mutex> lock(trashMutex);
+            if (reclaimerStop) {
+                ++kept;
+                continue;
+            }
+        }
+
+        // Anything not named by moveToTrash is left alone
+        char* end = nullptr;
+        const long long deletedAt = std::strtoll(entryName.c_str(), &end, 10);
+        if (end == entryName.c_str() || *end != '.') {
+            ++kept;
+            continue;
+        }
+        if (deletedAt + retentionSeconds > now) {
+            nextExpiry = std::min(nextExpiry, static_cast<time_t>(deletedAt + retentionSeconds));
+            ++kept;
+            continue;
+        }
+        reclaimTrashEntry(trashFd, entryName);
+    }
+    close(trashFd);
+    return kept > 0;
+}
+
+
+// Function run by the reclaimer thread: reclaims expired entries at background priority, then sleeps until the next one expires
+static void runTrashReclaimer() {
+    static const time_t retentionSeconds = std::max(0L, configNumber("trash_retention_minutes", 15)) * 60;
+    enterBackgroundPriority();
+
+    std::unique_lock<std::mutex> lock(trashMutex);
+    loadTrashRegistry();
+    while (!reclaimerStop) {
+        reclaimerWake = false;
+        const std::set<std::string> snapshot = trashDirectories;
+        lock.unlock();
+
+        time_t nextExpiry = std::numeric_limits<time_t>::max();
+        std::vector<std::string> emptied;
+        for (const std::string& trashDirectory : snapshot) {
+            if (!reclaimTrashDirectory(trashDirectory, retentionSeconds, nextExpiry)) {
+                emptied.push_back(trashDirectory);
+            }
+        }
+
+        lock.lock();
+        if (reclaimerStop) {
+            break;
+        }
+        // moveToTrash holds the lock while it renames, so an empty directory can not gain an entry while it is removed
+        bool registryChanged = false;
+        for (const std::string& trashDirectory : emptied) {
+            rmdir(trashDirectory.c_str());
+            registryChanged |= trashDirectories.erase(trashDirectory) > 0;
+        }
+        if (registryChanged) {
+            saveTrashRegistry();
+        }
+
+        if (nextExpiry == std::numeric_limits<time_t>::max()) {
+            trashCv.wait(lock, [] { return reclaimerStop || reclaimerWake; });
+        } else {
+            trashCv.wait_until(lock, std::chrono::system_clock::from_time_t(nextExpiry + 1), [] { return reclaimerStop || reclaimerWake; });
+        }
+    }
+
+    reclaimerRunning = false;
+    lock.unlock();
+    trashCv.notify_all();
+    leaveBackgroundPriority();
+}
+
+
+// Function to start the trash reclaimer, entries left by earlier sessions are reclaimed as they expire
+void startTrashReclaimer() {
+    std::lock_guard<std::mutex> lock(trashMutex);
+    if (reclaimerRunning) {
+        return;
+    }
+    reclaimerRunning = true;
+    reclaimerStop = false;
+    // Detached, so an exit from the signal handler does not meet a joinable thread
+    std::thread(runTrashReclaimer).detach();
+}
+
+
+// Function to stop the trash reclaimer before the program exits, a file it is shrinking stays in the trash for the next session
+void stopTrashReclaimer() {
+    std::unique_lock<std::mutex> lock(trashMutex);
+    reclaimerStop = true;
+    trashCv.notify_all();
+    trashCv.wait(lock, [] { return !reclaimerRunning; });
+}
@@ -5,17 +5,20 @@
 #include <atomic>
 #include <cctype>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <csignal>
 #include <cstring>
 #include <dirent.h>
 #include <fcntl.h>
 #include <filesystem>
+#include <fnmatch.h>
 #include <fstream>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <libmount/libmount.h>
+#include <map>
 #include <memory>
 #include <mntent.h>
 #include <mutex>
@@ -23,11 +26,14 @@
 #include <random>
 #include <readline/readline.h>
 #include <readline/history.h>
+#include <sched.h>
 #include <set>
 #include <shared_mutex>
 #include <string>
 #include <sys/mount.h>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <sys/file.h>
 #include <sys/mman.h>
@@ -54,10 +60,87 @@ extern bool historyPattern;
 
 extern bool verbose;
 
+// Physical directories (device, inode) already walked during one cache refresh and the shallowest depth they were reached at, shared by all walkers
+struct VisitedDirectories {
+    std::mutex mutex;
+    std::map<std::pair<dev_t, ino_t>, int> inodes;
+};
+
+// State of one root walk, shared with the walking thread so a walk hung on a stale mount can be abandoned
+struct RootScan {
+    std::string root;
+    std::atomic<bool> abandoned{false};        // Set by the waiter when the walk stalled past its deadline
+    std::atomic<int64_t> lastProgressNs{0};    // steady_clock time of the last directory or entry the walk got through
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool finished = false;
+    bool saving = false;                       // The walk finished in time and is writing its shard
+    bool saveSuccess = false;
+    std::vector<std::string> partialIsoFiles;  // ISO files of the directories walked so far
+    std::set<std::string> errorMessages;
+
+    // Record that the walk is still moving
+    void touch() {
+        lastProgressNs.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+};
+
+// Single gitignore-style prune rule
+struct PruneRule {
+    std::string pattern;
+    bool negate = false;    // '!pattern' re-includes a previously pruned path
+    bool dirOnly = false;   // 'pattern/' only matches directories
+    bool anchored = false;  // Patterns containing '/' match the path relative to the scan root
+};
+
+// Prune rules compiled for one scan root (built-in, global and per-root rules)
+struct PruneRules {
+    std::unordered_set<std::string> names;     // Literal basenames pruned as files or directories
+    std::unordered_set<std::string> dirNames;  // Literal basenames pruned as directories only
+    std::vector<PruneRule> patterns;           // Remaining rules, evaluated in order, last match wins
+    std::set<dev_t> excludedDevices;           // Pseudo filesystems and our own /mnt/iso_* mounts
+    dev_t rootDevice = 0;
+    bool oneFilesystem = false;                // Do not cross into other filesystems below the root
+};
+
+// Compiled search query of filterFiles and filterMountPoints, defined in filtering.cpp
+struct FilterQuery;
+
+// Identity of one loaded ISO catalog, equal generations mean equal contents
+struct CatalogGeneration {
+    uint64_t shards = 0;       // Hash of the path, inode, generation and size of every shard
+    uint64_t liveEpoch = 0;    // Live import results only grow within one epoch
+    size_t liveCount = 0;      // Live import results merged into the catalog
+    size_t entries = 0;        // Entries of the merged catalog
+
+    bool operator==(const CatalogGeneration& other) const = default;
+};
+
 //	CP&MV&RM
 
+// Streaming XXH64 state used to hash ISO data while it is copied
+struct Xxh64State {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t totalLength;
+    unsigned char buffer[32];
+    size_t bufferSize;
+};
+
 //	bools
 bool isValidLinuxPathFormat(const std::string& path);
+bool copyIsoFile(const std::string& srcPath, const std::string& destPath, std::string& errorDetail);
+bool moveIsoFile(const std::string& srcPath, const std::string& destPath, std::string& errorDetail);
+bool moveToTrash(const std::string& path, std::string& errorDetail);
+void startTrashReclaimer();
+void stopTrashReclaimer();
+void copyIsoFileToMany(const std::string& srcPath, const std::vector<std::string>& destPaths, std::vector<bool>& results, std::vector<std::string>& errorDetails);
+
+// Hash functions
+void xxh64Reset(Xxh64State& state, uint64_t seed);
+void xxh64Update(Xxh64State& state, const void* data, size_t length);
+uint64_t xxh64Digest(const Xxh64State& state);
 
 // General
 bool isValidDirectory(const std::string& path);
@@ -77,19 +160,40 @@ void handleIsoFileOperation(const std::vector<std::string>& isoFiles, std::vecto
 
 // Iso cache functions
 bool iequals(const std::string_view& a, const std::string_view& b);
-bool saveCache(const std::vector<std::string>& isoFiles, std::size_t maxCacheSize);
+bool saveCacheShard(const std::string& root, const std::vector<std::string>& isoFiles, bool replace);
+bool liveScanResultsSince(const CatalogGeneration& generation, size_t from, std::vector<std::string>& appended);
+bool resolveCollection(const std::string& reference, std::vector<std::string>& members, std::string& error);
+bool runCacheRefresh(const std::vector<std::string>& scanRoots, std::set<std::string>& uniqueErrorMessages, bool printProgress);
+bool startBackgroundRefresh(const std::vector<std::string>& scanRoots);
+bool markDirectoryVisited(VisitedDirectories& visitedDirectories, const struct stat& dirStat, int depth);
+bool isPruned(const PruneRules& pruneRules, const std::string& relativePath, const std::string& name, bool isDirectory);
+bool shouldDescend(const std::string& name, const std::string& relativePath, const struct stat& dirStat, int depth, const PruneRules& pruneRules, VisitedDirectories& visitedDirectories);
+bool traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, VisitedDirectories& visitedDirectories, const PruneRules& pruneRules, RootScan& scan);
 
 // Mount functions
 bool loadKernelModule(const std::string& moduleName);
 bool isAlreadyMounted(const std::string& mountPoint);
+bool isMountInFlight(const std::string& path);
 
 // Unmount functions
 bool isDirectoryEmpty(const std::string& path);
 
+// Watchdog functions
+bool runWatchedCall(const std::string& operationClass, std::function<void()> call);
+
 // General functions
 bool isAllZeros(const std::string& str);
+bool configFlag(const std::string& key, bool defaultValue);
 bool isNumeric(const std::string& str);
 
+// Watchdog functions
+int runWatchedProcess(const std::string& operationClass, const std::vector<std::string>& arguments, bool& timedOut);
+long watchdogTimeoutSeconds(const std::string& operationClass);
+
+//	unsigned ints
+
+// General functions
+unsigned int availableCpuCount();
 
 //	voids
 
@@ -101,6 +205,7 @@ void submenu2();
 void print_ascii();
 
 // General functions
+void loadConfig();
 void loadHistory();
 void saveHistory();
 void signalHandler(int signum);
@@ -120,38 +225,60 @@ void processAndMountIsoFiles(const std::string& input,
                              std::set<std::string>& mountedFails,
                              std::set<std::string>& uniqueErrorMessages);
 
+// Watchdog functions
+void killWatchedProcesses();
+
+// Background maintenance functions
+void enterBackgroundPriority();
+void leaveBackgroundPriority();
+void throttleBackgroundIo();
+
 // Cache functions
-void loadCache(std::vector<std::string>& isoFiles);
+void loadCache(std::vector<std::string>& isoFiles, CatalogGeneration* generation = nullptr);
 void manualRefreshCache(const std::string& initialDir = "");
-void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages);
-void refreshCacheForDirectory(const std::string& path, std::vector<std::string>& allIsoFiles, std::set<std::string>& uniqueErrorMessages);
+void refreshCacheForDirectory(std::shared_ptr<RootScan> scan, std::shared_ptr<VisitedDirectories> visitedDirectories, bool printProgress);
 void removeNonExistentPathsFromCache();
+void publishLiveScanResults(const std::vector<std::string>& isoFiles, size_t from, RootScan& scan);
+void updateCollections(const std::vector<std::string>& added, const std::vector<std::string>& removed);
+void printBackgroundRefreshStatus(bool showSummary);
+void waitForBackgroundRefresh();
 
 // Filter functions
 void sortFilesCaseInsensitive(std::vector<std::string>& files);
-void filterMountPoints(const std::vector<std::string>& isoDirs, std::vector<std::string>& filterPatterns, std::vector<std::string>& filteredIsoDirs, size_t start, size_t end);
-size_t boyerMooreSearchMountPoints(const std::string& haystack, const std::string& needle);
+void filterMountPoints(const std::vector<std::string>& isoDirs, const FilterQuery& query, std::vector<std::string>& filteredIsoDirs, size_t start, size_t end);
+size_t foldCaseUtf8(std::string_view text, char* out);
+size_t foldedCapacity(size_t length);
 
 // Unmount functions
 void printUnmountedAndErrors(bool invalidInput, std::set<std::string>& unmountedFiles, std::set<std::string>& unmountedErrors);
 void listMountedISOs();
 void unmountISOs();
 void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>& unmountedFiles, std::set<std::string>& unmountedErrors);
+void reclaimOrphanedLoopDevices(std::set<std::string>& reclaimedMessages);
 
 //	stds
 
 // General functions
+const std::vector<int>& allowedCpus();
+const std::vector<int>& allowedCpuNodes();
 std::string shell_escape(const std::string& s);
+std::string configValue(const std::string& key, const std::string& defaultValue);
+long configNumber(const std::string& key, long defaultValue);
 std::pair<std::string, std::string> extractDirectoryAndFilename(const std::string& path);
 
 
 // Cache functions
 std::string getHomeDirectory();
 std::vector<std::string> loadCache();
+std::vector<std::string> normalizeScanRoots(const std::vector<std::string>& paths);
+PruneRules compilePruneRules(const std::string& root);
 
 // Filter functions
-std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text);
+std::string foldCase(std::string_view text);
 std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query);
+std::vector<std::string> filterCatalog(const std::vector<std::string>& isoFiles, const CatalogGeneration& generation, const std::string& query);
+std::string emptyFilterMessage(const std::string& items);
+std::shared_ptr<const FilterQuery> compileFilterQuery(const std::vector<std::string>& tokens, std::string& error);
 
 // Unmount functions
 std::vector<std::string> parseUserInputUnmountISOs(const std::string& input, const std::vector<std::string>& isoDirs, bool& invalidInput, bool& noValid, bool& isFiltered);
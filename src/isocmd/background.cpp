@@ -0,0 +1,93 @@
+#include "../headers.h"
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+
+// BACKGROUND MAINTENANCE STUFF
+
+// ioprio_set(2) constants, glibc provides no wrapper
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_SHIFT = 13;
+const int IOPRIO_CLASS_BE = 2;
+const int IOPRIO_CLASS_IDLE = 3;
+
+// Priority of the calling thread before it entered background mode
+static thread_local int savedIoPriority = -1;
+static thread_local int savedNice = 0;
+static thread_local bool inBackgroundPriority = false;
+
+// Token bucket shared by all background workers
+static std::mutex tokenBucketMutex;
+static double tokenBucketTokens = 0.0;
+static std::chrono::steady_clock::time_point tokenBucketRefill = std::chrono::steady_clock::now();
+
+
+// Function to lower the I/O and CPU priority of the calling thread for maintenance work
+void enterBackgroundPriority() {
+    if (inBackgroundPriority) {
+        return;
+    }
+
+    // Thread id 0 targets the calling thread only, so interactive threads keep their priority
+    savedIoPriority = static_cast<int>(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+
+    // Idle class by default, "besteffort" keeps the thread in the normal class at the lowest level
+    int ioPriority = (configValue("background_io_class", "idle") == "besteffort")
+        ? (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 7
+        : (IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioPriority);
+
+    // On Linux the nice value is per thread when addressed by thread id
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    errno = 0;
+    savedNice = getpriority(PRIO_PROCESS, tid);
+    if (errno == 0) {
+        setpriority(PRIO_PROCESS, tid, std::min(19L, savedNice + configNumber("background_nice", 10)));
+    }
+
+    inBackgroundPriority = true;
+}
+
+
+// Function to restore the priority the calling thread had before enterBackgroundPriority()
+void leaveBackgroundPriority() {
+    if (!inBackgroundPriority) {
+        return;
+    }
+
+    if (savedIoPriority >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, savedIoPriority);
+    }
+    setpriority(PRIO_PROCESS, static_cast<pid_t>(syscall(SYS_gettid)), savedNice);
+
+    inBackgroundPriority = false;
+}
+
+
+// Function to wait for a token before a background filesystem operation (background_iops, 0 = unlimited)
+void throttleBackgroundIo() {
+    static const long opsPerSecond = configNumber("background_iops", 0);
+    if (opsPerSecond <= 0) {
+        return;
+    }
+
+    while (true) {
+        std::chrono::duration<double> wait;
+        {
+            std::lock_guard<std::mutex> lock(tokenBucketMutex);
+
+            // Refill for the elapsed time, allowing bursts of up to one second worth of operations
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - tokenBucketRefill).count();
+            tokenBucketTokens = std::min(static_cast<double>(opsPerSecond), tokenBucketTokens + elapsed * opsPerSecond);
+            tokenBucketRefill = now;
+
+            if (tokenBucketTokens >= 1.0) {
+                tokenBucketTokens -= 1.0;
+                return;
+            }
+            wait = std::chrono::duration<double>((1.0 - tokenBucketTokens) / opsPerSecond);
+        }
+        std::this_thread::sleep_for(wait);
+    }
+}
@@ -1,123 +1,454 @@
 #include "../headers.h"
+#include "../threadpool.h"
+#include "../arena.h"
 
 //	CACHE STUFF
 
 // Cache Variables
 
 const std::string cacheDirectory = std::string(std::getenv("HOME")) + "/.cache"; // Construct the full path to the cache directory
-const std::string cacheFileName = "iso_commander_cache.txt";
-const uintmax_t maxCacheSize = 10 * 1024 * 1024; // 10MB
+const std::string cacheFileName = "iso_commander_cache.txt"; // Single cache file of older versions, migrated into the shards
+const std::string shardDirectoryName = "iso_commander_shards"; // One catalog shard per scanned root, stored in the cache directory
+const std::string shardMagic = "#isocmd-shard 1";
+const uintmax_t maxCacheSize = 10 * 1024 * 1024; // Maximum bytes of ISO paths per shard, 10MB
+const std::string ignoreFileName = "iso_commander_ignore.txt"; // Global prune rules, stored in the cache directory
+const std::string rootIgnoreFileName = ".isocmdignore"; // Per-root prune rules, stored in the scan root
 
 int maxDepth = -1;
 
+// ISO files found by refreshes that are still running, merged into loadCache() until they are saved
+static std::vector<std::string> liveScanResults;
+static std::mutex liveScanMutex;
+static int activeLiveScans = 0;
+static uint64_t liveScanEpoch = 0; // Bumped whenever liveScanResults changes other than by appending
+
+// Background import started from the ImportISO menu
+static std::thread backgroundRefreshThread;
+static std::atomic<bool> backgroundRefreshRunning(false);
+static std::string backgroundRefreshSummary;
+
+// Serializes read-modify-write cycles of the cache shards within this process
+static std::mutex cacheFileMutex;
+
+// Number of shards listing each ISO path, roots may overlap and a path stays in the collections while any shard lists it
+// Rebuilt by loadCache() and kept up to date by writeShardFile(), a load that raced a write does not install its counts
+static std::mutex shardCountMutex;
+static std::unordered_map<std::string, unsigned> shardCountByPath;
+static bool shardCountsBuilt = false;
+static uint64_t shardCountUpdates = 0;
+
+// Roots with a walk thread still alive, including abandoned walks stuck on a stale mount
+static std::mutex walkingRootsMutex;
+static std::set<std::string> walkingRoots;
+static size_t abandonedWalks = 0;
+
+
+// One shard of the ISO catalog: the ISO files found below a single scan root
+struct CacheShard {
+    std::string root;          // Canonical scan root, empty for entries imported before the catalog was sharded
+    uint64_t generation = 0;   // Bumped on every rewrite of the shard
+    unsigned failures = 0;     // Consecutive stalled walks of the root, the root is degraded while non-zero
+    int64_t retryAfter = 0;    // Unix time before which a degraded root is not walked again
+    std::vector<std::string> isoFiles;
+};
+
+
+// Holds an exclusive flock on the shard directory, so read-modify-write cycles of other processes do not interleave
+struct ShardDirectoryLock {
+    int fd;
+
+    ShardDirectoryLock() : fd(open((cacheDirectory + "/" + shardDirectoryName + "/.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+        if (fd != -1) {
+            flock(fd, LOCK_EX);
+        }
+    }
 
-// Function to remove non-existent paths from cache
-void removeNonExistentPathsFromCache() {
-    const std::string cacheFilePath = std::string(getenv("HOME")) + "/.cache/iso_commander_cache.txt";
-	
-    // Open the cache file for reading
-    int fd = open(cacheFilePath.c_str(), O_RDONLY);
+    ~ShardDirectoryLock() {
+        if (fd != -1) {
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+    }
+};
+
+
+// Function to create the shard directory, returns false if the cache directory is missing
+static bool ensureShardDirectory() {
+    if (!std::filesystem::is_directory(cacheDirectory)) {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDirectory + "/" + shardDirectoryName, ec);
+    return std::filesystem::is_directory(cacheDirectory + "/" + shardDirectoryName);
+}
+
+
+// Function to name the shard file of a root after the XXH64 of the root path
+static std::string shardPathForRoot(const std::string& root) {
+    Xxh64State state;
+    xxh64Reset(state, 0);
+    xxh64Update(state, root.data(), root.size());
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.shard", static_cast<unsigned long long>(xxh64Digest(state)));
+    return cacheDirectory + "/" + shardDirectoryName + "/" + name;
+}
+
+
+// Function to list the shard files of the catalog
+static std::vector<std::string> listShardFiles() {
+    std::vector<std::string> shardPaths;
+    const std::string shardDirectory = cacheDirectory + "/" + shardDirectoryName;
+    DIR* dir = opendir(shardDirectory.c_str());
+    if (dir == nullptr) {
+        return shardPaths;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string_view name(entry->d_name);
+        if (name.size() > 6 && name.substr(name.size() - 6) == ".shard") {
+            shardPaths.push_back(shardDirectory + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    return shardPaths;
+}
+
+
+// Function to read a memory mapped file line by line, empty lines are skipped
+static bool readMappedLines(const std::string& filePath, std::vector<std::string>& lines) {
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
     if (fd == -1) {
-        return;
+        return false;
     }
 
-    // Lock the file to prevent concurrent access
-    if (flock(fd, LOCK_EX) == -1) {
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1) {
         close(fd);
-        return;
+        return false;
     }
-
-    // Get the file size
-    struct stat sb;
-    if (fstat(fd, &sb) == -1) {
-        flock(fd, LOCK_UN);
+    if (fileStat.st_size == 0) {
         close(fd);
-        return;
+        return true;
     }
 
-    size_t fileSize = sb.st_size;
-
-    // Memory map the file
+    const size_t fileSize = fileStat.st_size;
     char* mappedFile = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
     if (mappedFile == MAP_FAILED) {
-        flock(fd, LOCK_UN);
         close(fd);
-        return;
+        return false;
     }
 
-    // Read the file into a vector of strings
-    std::vector<std::string> cache;
     char* start = mappedFile;
     char* end = mappedFile + fileSize;
     while (start < end) {
         char* lineEnd = std::find(start, end, '\n');
-        cache.emplace_back(start, lineEnd);
+        if (lineEnd != start) {
+            lines.emplace_back(start, lineEnd);
+        }
         start = lineEnd + 1;
     }
 
-    // Unmap and close the file
     munmap(mappedFile, fileSize);
-    flock(fd, LOCK_UN);
     close(fd);
+    return true;
+}
+
+
+// Function to read one shard, the header holds the magic line, the root, the generation, the entry count and the degraded state
+static bool readShardFile(const std::string& shardPath, CacheShard& shard) {
+    std::vector<std::string> lines;
+    if (!readMappedLines(shardPath, lines) || lines.size() < 3 || lines[0] != shardMagic) {
+        return false;
+    }
 
-    // Determine batch size
-    const size_t maxThreads = std::thread::hardware_concurrency();
-    const size_t batchSize = std::max(cache.size() / maxThreads + 1, static_cast<size_t>(2));
+    // Header lines are key=value pairs, the ISO paths that follow are absolute
+    size_t headerLines = 1;
+    for (; headerLines < lines.size() && lines[headerLines][0] != '/'; ++headerLines) {
+        const std::string& line = lines[headerLines];
+        if (line.rfind("root=", 0) == 0) {
+            shard.root = line.substr(5);
+        } else if (line.rfind("generation=", 0) == 0) {
+            shard.generation = std::strtoull(line.c_str() + 11, nullptr, 10);
+        } else if (line.rfind("failures=", 0) == 0) {
+            shard.failures = static_cast<unsigned>(std::strtoul(line.c_str() + 9, nullptr, 10));
+        } else if (line.rfind("retry_after=", 0) == 0) {
+            shard.retryAfter = std::strtoll(line.c_str() + 12, nullptr, 10);
+        }
+    }
+
+    shard.isoFiles.assign(std::make_move_iterator(lines.begin() + headerLines), std::make_move_iterator(lines.end()));
+    return true;
+}
+
+
+// Function to replace a shard through a temporary file and rename, so readers never see it half written
+static bool replaceShardFile(CacheShard& shard) {
+    const std::string shardPath = shardPathForRoot(shard.root);
+
+    // A root without ISO files needs no shard, unless it carries the backoff of a degraded root
+    if (shard.isoFiles.empty() && shard.failures == 0) {
+        return unlink(shardPath.c_str()) == 0 || errno == ENOENT;
+    }
+
+    const std::string tempPath = shardPath + ".tmp" + std::to_string(getpid());
+    ++shard.generation;
+    {
+        std::ofstream shardFile(tempPath, std::ios::out | std::ios::trunc);
+        if (!shardFile.is_open()) {
+            return false;
+        }
+        shardFile << shardMagic << "\nroot=" << shard.root << "\ngeneration=" << shard.generation << "\ncount=" << shard.isoFiles.size() << "\n";
+        if (shard.failures > 0) {
+            shardFile << "failures=" << shard.failures << "\nretry_after=" << shard.retryAfter << "\n";
+        }
+        for (const std::string& iso : shard.isoFiles) {
+            shardFile << iso << "\n";
+        }
+        shardFile.flush();
+        if (!shardFile.good()) {
+            shardFile.close();
+            unlink(tempPath.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tempPath.c_str(), shardPath.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// Function to count the shards listing each path from the shard files, called with shardCountMutex held and the shard directory locked
+static void buildShardCounts() {
+    shardCountByPath.clear();
+    for (const std::string& shardPath : listShardFiles()) {
+        CacheShard shard;
+        if (readShardFile(shardPath, shard)) {
+            for (std::string& iso : shard.isoFiles) {
+                ++shardCountByPath[std::move(iso)];
+            }
+        }
+    }
+    shardCountsBuilt = true;
+}
+
+
+// Function to write a shard and pass the entries it gained and lost on to the saved collections, called with the shard directory locked
+static bool writeShardFile(CacheShard& shard) {
+    // Only a write before the first catalog load has to count the shards itself
+    {
+        std::lock_guard<std::mutex> lock(shardCountMutex);
+        if (!shardCountsBuilt) {
+            buildShardCounts();
+        }
+    }
+
+    CacheShard previous;
+    readShardFile(shardPathForRoot(shard.root), previous);
+    if (!replaceShardFile(shard)) {
+        return false;
+    }
+
+    std::vector<std::string> before = std::move(previous.isoFiles);
+    std::vector<std::string> after = shard.isoFiles;
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    std::vector<std::string> added, removed;
+    std::set_difference(after.begin(), after.end(), before.begin(), before.end(), std::back_inserter(added));
+    std::set_difference(before.begin(), before.end(), after.begin(), after.end(), std::back_inserter(removed));
+
+    // A path that left this shard stays in the collections while another shard still lists it
+    {
+        std::lock_guard<std::mutex> lock(shardCountMutex);
+        for (const std::string& path : added) {
+            ++shardCountByPath[path];
+        }
+        removed.erase(std::remove_if(removed.begin(), removed.end(), [](const std::string& path) {
+            auto it = shardCountByPath.find(path);
+            if (it == shardCountByPath.end() || --it->second == 0) {
+                if (it != shardCountByPath.end()) {
+                    shardCountByPath.erase(it);
+                }
+                return false;
+            }
+            return true;
+        }), removed.end());
+        ++shardCountUpdates;
+    }
+    updateCollections(added, removed);
+    return true;
+}
+
+
+// Function to move the single pre-shard cache file into the unassigned shard, called with cacheFileMutex held
+static void migrateLegacyCacheFile() {
+    const std::string legacyPath = cacheDirectory + "/" + cacheFileName;
+    if (access(legacyPath.c_str(), F_OK) != 0 || !ensureShardDirectory()) {
+        return;
+    }
+
+    ShardDirectoryLock directoryLock;
+    std::vector<std::string> legacyEntries;
+    if (!readMappedLines(legacyPath, legacyEntries)) {
+        return;
+    }
+
+    CacheShard shard;
+    readShardFile(shardPathForRoot(""), shard);
+    std::set<std::string> combined(shard.isoFiles.begin(), shard.isoFiles.end());
+    combined.insert(std::make_move_iterator(legacyEntries.begin()), std::make_move_iterator(legacyEntries.end()));
+    shard.root.clear();
+    shard.isoFiles.assign(combined.begin(), combined.end());
+
+    if (writeShardFile(shard)) {
+        unlink(legacyPath.c_str());
+    }
+}
+
+
+static int64_t markShardDegraded(const std::string& root, const std::vector<std::string>& partialIsoFiles, int64_t baseBackoffSeconds);
+
+
+// Function to remove non-existent paths from cache, shards whose root is missing are left as they are
+void removeNonExistentPathsFromCache() {
+    // Drop live results of a running import whose files have disappeared meanwhile, checked outside the lock so walkers are not held up
+    std::vector<std::string> liveSnapshot;
+    {
+        std::lock_guard<std::mutex> lock(liveScanMutex);
+        liveSnapshot = liveScanResults;
+    }
+    std::unordered_set<std::string> liveMissing;
+    for (const std::string& path : liveSnapshot) {
+        if (!std::filesystem::exists(path)) {
+            liveMissing.insert(path);
+        }
+    }
+    if (!liveMissing.empty()) {
+        std::lock_guard<std::mutex> lock(liveScanMutex);
+        auto firstMissing = std::remove_if(liveScanResults.begin(), liveScanResults.end(),
+            [&liveMissing](const std::string& path) { return liveMissing.count(path) != 0; });
+        if (firstMissing != liveScanResults.end()) {
+            liveScanResults.erase(firstMissing, liveScanResults.end());
+            ++liveScanEpoch;
+        }
+    }
+
+    // Snapshot every shard, imports may rewrite shards while the existence checks run
+    std::vector<CacheShard> shards;
+    {
+        std::lock_guard<std::mutex> cacheLock(cacheFileMutex);
+        migrateLegacyCacheFile();
+        for (const std::string& shardPath : listShardFiles()) {
+            CacheShard shard;
+            if (!readShardFile(shardPath, shard)) {
+                continue;
+            }
+            // Degraded roots are not touched until their backoff expires, a stale mount would hang the checks
+            if (shard.retryAfter > static_cast<int64_t>(time(nullptr))) {
+                continue;
+            }
+            shards.push_back(std::move(shard));
+        }
+    }
+
+    // Check the roots in parallel and outside the lock, each under the scan stall deadline so a stale mount cannot hang the sweep
+    std::vector<std::future<int>> rootChecks;
+    for (const CacheShard& shard : shards) {
+        rootChecks.push_back(std::async(std::launch::async, [root = shard.root]() {
+            if (root.empty()) {
+                return 1;
+            }
+            auto isDirectory = std::make_shared<std::atomic<bool>>(false);
+            if (!runWatchedCall("scan", [root, isDirectory]() { isDirectory->store(std::filesystem::is_directory(root)); })) {
+                return -1;
+            }
+            return isDirectory->load() ? 1 : 0;
+        }));
+    }
+    std::vector<std::string> stalledRoots;
+    size_t kept = 0;
+    for (size_t shardIndex = 0; shardIndex < shards.size(); ++shardIndex) {
+        const int rootState = rootChecks[shardIndex].get();
+        // A missing root may be an unmounted NAS or USB disk, its shard is kept until the root is back
+        if (rootState == 0) {
+            continue;
+        }
+        // A root that stalled is degraded like a stalled walk, later sweeps skip it until its backoff expires
+        if (rootState < 0) {
+            stalledRoots.push_back(shards[shardIndex].root);
+            continue;
+        }
+        if (kept != shardIndex) {
+            shards[kept] = std::move(shards[shardIndex]);
+        }
+        ++kept;
+    }
+    shards.resize(kept);
+    for (const std::string& root : stalledRoots) {
+        markShardDegraded(root, {}, watchdogTimeoutSeconds("scan"));
+    }
+
+    // Flatten the shards so the batches balance across all of them
+    std::vector<std::pair<size_t, const std::string*>> cache;
+    for (size_t shardIndex = 0; shardIndex < shards.size(); ++shardIndex) {
+        for (const std::string& path : shards[shardIndex].isoFiles) {
+            cache.emplace_back(shardIndex, &path);
+        }
+    }
+
+    // Determine batch size from the concurrency the previous sweeps converged on
+    ConcurrencyController& sweepController = concurrencyControllerFor("sweep");
+    const size_t batchSize = std::max(cache.size() / sweepController.currentLimit() + 1, static_cast<size_t>(2));
 
     // Create a vector to hold futures
-    std::vector<std::future<std::vector<std::string>>> futures;
+    std::vector<std::future<std::vector<std::pair<size_t, const std::string*>>>> futures;
 
     // Process paths in batches
     for (size_t i = 0; i < cache.size(); i += batchSize) {
         auto begin = cache.begin() + i;
         auto end = std::min(begin + batchSize, cache.end());
-            futures.push_back(std::async(std::launch::async, [begin, end]() {
-            std::vector<std::string> result;
+            futures.push_back(std::async(std::launch::async, [begin, end, &sweepController]() {
+            // The sweep is maintenance work, keep it out of the way of served ISOs
+            enterBackgroundPriority();
+            std::vector<std::pair<size_t, const std::string*>> missing;
             for (auto it = begin; it != end; ++it) {
-                if (std::filesystem::exists(*it)) {
-                    result.push_back(*it);
+                throttleBackgroundIo();
+                ConcurrencyController::Slot slot(sweepController);
+                if (!std::filesystem::exists(*it->second)) {
+                    missing.push_back(*it);
                 }
             }
-            return result;
+            leaveBackgroundPriority();
+            return missing;
         }));
     }
 
-    // Collect results
-    std::vector<std::string> retainedPaths;
+    // Collect the missing paths of each shard
+    std::vector<std::unordered_set<std::string>> missingByShard(shards.size());
     for (auto& future : futures) {
-        auto result = future.get();
-        retainedPaths.insert(retainedPaths.end(), std::make_move_iterator(result.begin()), std::make_move_iterator(result.end()));
-    }
-
-    // Open the cache file for writing
-    fd = open(cacheFilePath.c_str(), O_WRONLY);
-    if (fd == -1) {
-        return;
-    }
-
-    // Lock the file to prevent concurrent access
-    if (flock(fd, LOCK_EX) == -1) {
-        close(fd);
-        return;
+        for (const auto& [shardIndex, path] : future.get()) {
+            missingByShard[shardIndex].insert(*path);
+        }
     }
 
-    // Write the retained paths to the updated cache file
-    std::ofstream updatedCacheFile(cacheFilePath, std::ios::out | std::ios::trunc);
-    if (!updatedCacheFile.is_open()) {
-        flock(fd, LOCK_UN);
-        close(fd);
-        return;
+    // Rewrite only the shards that lost entries, re-read under the lock so concurrent additions are kept
+    std::lock_guard<std::mutex> cacheLock(cacheFileMutex);
+    ShardDirectoryLock directoryLock;
+    for (size_t shardIndex = 0; shardIndex < shards.size(); ++shardIndex) {
+        if (missingByShard[shardIndex].empty()) {
+            continue;
+        }
+        CacheShard current;
+        if (!readShardFile(shardPathForRoot(shards[shardIndex].root), current)) {
+            continue;
+        }
+        const auto& missing = missingByShard[shardIndex];
+        current.isoFiles.erase(std::remove_if(current.isoFiles.begin(), current.isoFiles.end(),
+            [&missing](const std::string& path) { return missing.count(path) != 0; }), current.isoFiles.end());
+        writeShardFile(current);
     }
-
-    for (const std::string& path : retainedPaths) {
-		if (std::filesystem::exists(path)) {
-			updatedCacheFile << path << '\n';
-		}
-	}
-
-    // RAII: Close the file and release the lock
-    flock(fd, LOCK_UN);
-    close(fd);
 }
 
 
@@ -131,62 +462,100 @@ std::string getHomeDirectory() {
 }
 
 
-// Load cache
-void loadCache(std::vector<std::string>& isoFiles) {
-    std::string cacheFilePath = getHomeDirectory() + "/.cache/iso_commander_cache.txt";
-    
-    // Check if the cache file exists
-    struct stat fileStat;
-    if (stat(cacheFilePath.c_str(), &fileStat) == -1) {
-        // File doesn't exist, handle error or just return
-        return;
-    }
-    
-    // Check if the file is empty
-    if (fileStat.st_size == 0) {
-		isoFiles.clear();  // Clear the vector to ensure we don't retain old data
-        return;  // File is empty, no need to process
+// Load cache, shards are read in parallel and merged; generation, if given, receives the identity of what was loaded
+void loadCache(std::vector<std::string>& isoFiles, CatalogGeneration* generation) {
+    if (access((cacheDirectory + "/" + cacheFileName).c_str(), F_OK) == 0) {
+        std::lock_guard<std::mutex> cacheLock(cacheFileMutex);
+        migrateLegacyCacheFile();
     }
 
-    // Open the file for memory mapping
-    int fd = open(cacheFilePath.c_str(), O_RDONLY);
-    if (fd == -1) {
-        // Handle error if unable to open the file
-        return;
+    uint64_t shardCountUpdatesBefore;
+    {
+        std::lock_guard<std::mutex> lock(shardCountMutex);
+        shardCountUpdatesBefore = shardCountUpdates;
     }
 
-    // Get the file size
-    const auto fileSize = fileStat.st_size;
+    const std::vector<std::string> shardPaths = listShardFiles();
+    std::vector<std::vector<std::string>> shardContents(shardPaths.size());
+    std::vector<std::array<uint64_t, 3>> shardVersions(shardPaths.size(), {0, 0, 0});
 
-    // Memory map the file
-    char* mappedFile = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
-    if (mappedFile == MAP_FAILED) {
-        // Handle error if unable to map the file
-        close(fd);
-        return;
+    // One reader per group of shards, at most maxThreads at once
+    const size_t readers = std::max<size_t>(1, std::min<size_t>(maxThreads, shardPaths.size()));
+    std::vector<std::future<void>> futures;
+    for (size_t reader = 0; reader < readers && reader < shardPaths.size(); ++reader) {
+        futures.push_back(std::async(std::launch::async, [&, reader]() {
+            for (size_t i = reader; i < shardPaths.size(); i += readers) {
+                // Shards are replaced by rename, the inode taken before reading changes with any newer content
+                struct stat shardStat;
+                if (stat(shardPaths[i].c_str(), &shardStat) != 0) {
+                    continue;
+                }
+                CacheShard shard;
+                if (readShardFile(shardPaths[i], shard)) {
+                    shardVersions[i] = {static_cast<uint64_t>(shardStat.st_ino), shard.generation, shard.isoFiles.size()};
+                    shardContents[i] = std::move(shard.isoFiles);
+                }
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
     }
 
-    // Use a set to store unique lines
-    std::set<std::string> uniqueIsoFiles;
+    // Recount the shards listing each path, unless a shard was written while they were read
+    std::unordered_map<std::string, unsigned> shardCounts;
+    for (const auto& contents : shardContents) {
+        for (const std::string& iso : contents) {
+            ++shardCounts[iso];
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(shardCountMutex);
+        if (shardCountUpdates == shardCountUpdatesBefore) {
+            shardCountByPath = std::move(shardCounts);
+            shardCountsBuilt = true;
+        }
+    }
 
-    // Process the memory-mapped file
-    char* start = mappedFile;
-    char* end = mappedFile + fileSize;
-    while (start < end) {
-        char* lineEnd = std::find(start, end, '\n');
-        std::string line(start, lineEnd);
-        if (!line.empty()) {
-            uniqueIsoFiles.insert(std::move(line));
+    // Merge the shards and the ISO files found by an import that has not saved yet, without duplicates
+    isoFiles.clear();
+    for (auto& contents : shardContents) {
+        isoFiles.insert(isoFiles.end(), std::make_move_iterator(contents.begin()), std::make_move_iterator(contents.end()));
+    }
+    size_t liveCount;
+    uint64_t liveEpoch;
+    {
+        std::lock_guard<std::mutex> lock(liveScanMutex);
+        isoFiles.insert(isoFiles.end(), liveScanResults.begin(), liveScanResults.end());
+        liveCount = liveScanResults.size();
+        liveEpoch = liveScanEpoch;
+    }
+    std::sort(isoFiles.begin(), isoFiles.end());
+    isoFiles.erase(std::unique(isoFiles.begin(), isoFiles.end()), isoFiles.end());
+
+    if (generation != nullptr) {
+        Xxh64State state;
+        xxh64Reset(state, 0);
+        for (size_t i = 0; i < shardPaths.size(); ++i) {
+            xxh64Update(state, shardPaths[i].data(), shardPaths[i].size() + 1);
+            xxh64Update(state, shardVersions[i].data(), sizeof(shardVersions[i]));
         }
-        start = lineEnd + 1;
+        generation->shards = xxh64Digest(state);
+        generation->liveEpoch = liveEpoch;
+        generation->liveCount = liveCount;
+        generation->entries = isoFiles.size();
     }
+}
 
-    // Unmap the file
-    munmap(mappedFile, fileSize);
-    close(fd);
 
-    // Convert the set to the vector reference
-    isoFiles.assign(uniqueIsoFiles.begin(), uniqueIsoFiles.end());
+// Function to copy the live import results a catalog load merged after position from, false if they changed other than by appending
+bool liveScanResultsSince(const CatalogGeneration& generation, size_t from, std::vector<std::string>& appended) {
+    std::lock_guard<std::mutex> lock(liveScanMutex);
+    if (liveScanEpoch != generation.liveEpoch || liveScanResults.size() < generation.liveCount || from > generation.liveCount) {
+        return false;
+    }
+    appended.assign(liveScanResults.begin() + from, liveScanResults.begin() + generation.liveCount);
+    return true;
 }
 
 
@@ -196,49 +565,81 @@ bool exists(const std::filesystem::path& path) {
 }
 
 
-// Save cache
-bool saveCache(const std::vector<std::string>& isoFiles, std::size_t maxCacheSize) {
-    std::filesystem::path cachePath = cacheDirectory;
-    cachePath /= cacheFileName;
+// Function to limit the ISO paths of a shard to maxCacheSize bytes, dropping the first entries in path order like the single cache file did
+static void limitShardSize(std::set<std::string>& combinedCache) {
+    uintmax_t totalSize = 0;
+    for (const std::string& iso : combinedCache) {
+        totalSize += iso.size() + 1;
+    }
+    while (totalSize > maxCacheSize && !combinedCache.empty()) {
+        totalSize -= combinedCache.begin()->size() + 1;
+        combinedCache.erase(combinedCache.begin());
+    }
+}
+
 
-    // Check if cache directory exists
-    if (!std::filesystem::exists(cacheDirectory) || !std::filesystem::is_directory(cacheDirectory)) {
+// Save the ISO files of one scan root into its shard, a full walk replaces the shard and a shallow one merges into it
+bool saveCacheShard(const std::string& root, const std::vector<std::string>& isoFiles, bool replace) {
+    if (!ensureShardDirectory()) {
         return false;  // Cache save failed
     }
 
-    // Load the existing cache into a local vector
-    std::vector<std::string> existingCache;
-    loadCache(existingCache);
+    // Concurrent imports and the sweep must not overwrite each other's results
+    std::lock_guard<std::mutex> cacheLock(cacheFileMutex);
+    ShardDirectoryLock directoryLock;
 
-    // Combine new and existing entries and remove duplicates
-    std::set<std::string> combinedCache(existingCache.begin(), existingCache.end());
-    for (const std::string& iso : isoFiles) {
-        combinedCache.insert(iso);
+    CacheShard shard;
+    readShardFile(shardPathForRoot(root), shard);
+    shard.root = root;
+
+    std::set<std::string> combinedCache(isoFiles.begin(), isoFiles.end());
+    if (!replace) {
+        combinedCache.insert(shard.isoFiles.begin(), shard.isoFiles.end());
     }
+    limitShardSize(combinedCache);
 
-    // Limit the cache size to the maximum allowed size
-    while (combinedCache.size() > maxCacheSize) {
-        combinedCache.erase(combinedCache.begin());
+    // A walk that finished in time clears the degraded state of its root
+    shard.failures = 0;
+    shard.retryAfter = 0;
+    shard.isoFiles.assign(combinedCache.begin(), combinedCache.end());
+    return writeShardFile(shard);
+}
+
+
+// Mark the root of an abandoned walk as degraded, keep its partial results and back off exponentially, returns the backoff in seconds
+static int64_t markShardDegraded(const std::string& root, const std::vector<std::string>& partialIsoFiles, int64_t baseBackoffSeconds) {
+    if (!ensureShardDirectory()) {
+        return 0;
     }
 
-    // Open the cache file in write mode (truncating it)
-    std::ofstream cacheFile(cachePath, std::ios::out | std::ios::trunc);
-    if (cacheFile.is_open()) {
-        for (const std::string& iso : combinedCache) {
-            cacheFile << iso << "\n";
-        }
+    std::lock_guard<std::mutex> cacheLock(cacheFileMutex);
+    ShardDirectoryLock directoryLock;
 
-        // Check if writing to the file was successful
-        if (cacheFile.good()) {
-            cacheFile.close();
-            return true;  // Cache save successful
-        } else {
-            cacheFile.close();
-            return false;  // Cache save failed
-        }
-    } else {
-        return false;  // Cache save failed
+    CacheShard shard;
+    readShardFile(shardPathForRoot(root), shard);
+    shard.root = root;
+
+    std::set<std::string> combinedCache(shard.isoFiles.begin(), shard.isoFiles.end());
+    combinedCache.insert(partialIsoFiles.begin(), partialIsoFiles.end());
+    limitShardSize(combinedCache);
+    shard.isoFiles.assign(combinedCache.begin(), combinedCache.end());
+
+    // Double the backoff on every consecutive stall, capped at one day
+    ++shard.failures;
+    const int64_t backoff = std::min<int64_t>(std::max<int64_t>(baseBackoffSeconds, 1) << std::min(shard.failures - 1, 16u), 24 * 60 * 60);
+    shard.retryAfter = static_cast<int64_t>(time(nullptr)) + backoff;
+    writeShardFile(shard);
+    return backoff;
+}
+
+
+// Function to get the time before which a degraded root must not be walked again, 0 for healthy roots
+static int64_t shardRetryAfter(const std::string& root) {
+    CacheShard shard;
+    if (!readShardFile(shardPathForRoot(root), shard)) {
+        return 0;
     }
+    return shard.retryAfter;
 }
 
 
@@ -248,37 +649,466 @@ bool isValidDirectory(const std::string& path) {
 }
 
 
-// Function to refresh the cache for a single directory
-void refreshCacheForDirectory(const std::string& path, std::vector<std::string>& allIsoFiles, std::set<std::string>& uniqueErrorMessages) {
-	if (promptFlag) {
+// Function to resolve scan roots to their real paths and drop duplicates or roots nested inside other roots
+std::vector<std::string> normalizeScanRoots(const std::vector<std::string>& paths) {
+	std::set<std::string> canonicalRoots;
+	for (const auto& path : paths) {
+		char* resolved = realpath(path.c_str(), nullptr);
+		if (resolved != nullptr) {
+			canonicalRoots.insert(resolved);
+			free(resolved);
+		} else {
+			canonicalRoots.insert(path);
+		}
+	}
+
+	// Nested roots are only covered by their parent when the walk is unbounded
+	if (maxDepth >= 0) {
+		return std::vector<std::string>(canonicalRoots.begin(), canonicalRoots.end());
+	}
+
+	// The set is ordered, so a parent root always precedes the roots it contains
+	std::vector<std::string> roots;
+	for (const auto& root : canonicalRoots) {
+		bool contained = false;
+		for (const auto& parent : roots) {
+			if (root.compare(0, parent.size(), parent) == 0 &&
+				(parent == "/" || root.size() == parent.size() || root[parent.size()] == '/')) {
+				contained = true;
+				break;
+			}
+		}
+		if (!contained) {
+			roots.push_back(root);
+		}
+	}
+	return roots;
+}
+
+
+// Function to record a directory as walked at a depth, returns false if a walker already reached it with at least as much depth left
+bool markDirectoryVisited(VisitedDirectories& visitedDirectories, const struct stat& dirStat, int depth) {
+	std::lock_guard<std::mutex> lock(visitedDirectories.mutex);
+	auto [it, inserted] = visitedDirectories.inodes.emplace(std::make_pair(dirStat.st_dev, dirStat.st_ino), depth);
+	if (inserted) {
+		return true;
+	}
+
+	// Under a depth limit a shallower visit reaches further below the directory, so results do not depend on which walker came first
+	if (maxDepth >= 0 && depth < it->second) {
+		it->second = depth;
+		return true;
+	}
+	return false;
+}
+
+
+// Function to compile the built-in, global and per-root prune rules for a scan root
+PruneRules compilePruneRules(const std::string& root) {
+	PruneRules pruneRules;
+	std::vector<PruneRule> rules;
+
+	// Parse one gitignore-style line
+	auto addRule = [&rules](std::string line) {
+		while (!line.empty() && (line.back() == ' ' || line.back() == '\t' || line.back() == '\r')) {
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#') {
+			return;
+		}
+
+		PruneRule rule;
+		if (line[0] == '!') {
+			rule.negate = true;
+			line.erase(0, 1);
+		} else if (line[0] == '\\') {
+			line.erase(0, 1); // Escaped leading '#' or '!'
+		}
+		if (!line.empty() && line.back() == '/') {
+			rule.dirOnly = true;
+			line.pop_back();
+		}
+		if (line.compare(0, 3, "**/") == 0) {
+			line.erase(0, 3); // Matches at any depth, same as an unanchored pattern
+		}
+		if (line.find('/') != std::string::npos) {
+			rule.anchored = true;
+			line.erase(0, line.find_first_not_of('/'));
+		}
+		if (line.empty()) {
+			return;
+		}
+
+		rule.pattern = std::move(line);
+		rules.push_back(std::move(rule));
+	};
+
+	// Built-in rules for trees that never hold ISO libraries, the global file can re-include them with '!'
+	for (const char* builtin : {".git/", ".hg/", ".svn/", "node_modules/", ".snapshot/", ".snapshots/", ".zfs/", ".Trash-*/", ".isocmd-trash/", "lost+found/"}) {
+		addRule(builtin);
+	}
+
+	for (const std::string& ignoreFile : {cacheDirectory + "/" + ignoreFileName, root + "/" + rootIgnoreFileName}) {
+		std::ifstream file(ignoreFile);
+		std::string line;
+		while (std::getline(file, line)) {
+			addRule(line);
+		}
+	}
+
+	// Literal rules go into hash sets unless negations make the evaluation order significant
+	bool hasNegation = std::any_of(rules.begin(), rules.end(), [](const PruneRule& rule) { return rule.negate; });
+	for (auto& rule : rules) {
+		bool literal = rule.pattern.find_first_of("*?[\\") == std::string::npos;
+		if (literal && !rule.anchored && !hasNegation) {
+			(rule.dirOnly ? pruneRules.dirNames : pruneRules.names).insert(rule.pattern);
+		} else {
+			pruneRules.patterns.push_back(std::move(rule));
+		}
+	}
+
+	struct stat rootStat;
+	if (stat(root.c_str(), &rootStat) == 0) {
+		pruneRules.rootDevice = rootStat.st_dev;
+	}
+	pruneRules.oneFilesystem = configFlag("scan_one_filesystem", false);
+
+	// Pseudo filesystems below the root are never scanned
+	for (const char* pseudo : {"/proc", "/sys", "/dev"}) {
+		struct stat pseudoStat;
+		if (stat(pseudo, &pseudoStat) == 0 && pseudoStat.st_dev != pruneRules.rootDevice) {
+			pruneRules.excludedDevices.insert(pseudoStat.st_dev);
+		}
+	}
+
+	// Neither are our own ISO mounts
+	struct stat mntStat;
+	DIR* mntDir = opendir("/mnt");
+	if (mntDir != nullptr && fstat(dirfd(mntDir), &mntStat) == 0) {
+		struct dirent* entry;
+		while ((entry = readdir(mntDir)) != nullptr) {
+			struct stat isoStat;
+			if (strncmp(entry->d_name, "iso_", 4) == 0 &&
+				fstatat(dirfd(mntDir), entry->d_name, &isoStat, 0) == 0 && isoStat.st_dev != mntStat.st_dev) {
+				pruneRules.excludedDevices.insert(isoStat.st_dev);
+			}
+		}
+	}
+	if (mntDir != nullptr) {
+		closedir(mntDir);
+	}
+
+	return pruneRules;
+}
+
+
+// Function to check a path against the compiled prune rules
+bool isPruned(const PruneRules& pruneRules, const std::string& relativePath, const std::string& name, bool isDirectory) {
+	if (pruneRules.names.count(name) || (isDirectory && pruneRules.dirNames.count(name))) {
+		return true;
+	}
+
+	bool pruned = false;
+	for (const auto& rule : pruneRules.patterns) {
+		if (rule.dirOnly && !isDirectory) {
+			continue;
+		}
+		const std::string& subject = rule.anchored ? relativePath : name;
+		if (fnmatch(rule.pattern.c_str(), subject.c_str(), rule.anchored ? FNM_PATHNAME : 0) == 0) {
+			pruned = !rule.negate;
+		}
+	}
+	return pruned;
+}
+
+
+// Function to decide whether a directory is walked, pruned subtrees are never opened
+bool shouldDescend(const std::string& name, const std::string& relativePath, const struct stat& dirStat, int depth, const PruneRules& pruneRules, VisitedDirectories& visitedDirectories) {
+	if (isPruned(pruneRules, relativePath, name, true)) {
+		return false;
+	}
+	if (pruneRules.excludedDevices.count(dirStat.st_dev) ||
+		(pruneRules.oneFilesystem && dirStat.st_dev != pruneRules.rootDevice)) {
+		return false;
+	}
+
+	// Descend into each physical directory only once, which also breaks symlink cycles
+	return markDirectoryVisited(visitedDirectories, dirStat, depth);
+}
+
+
+// Function to refresh the cache for a single directory, its shard is saved as soon as the walk of this root ends
+// Runs on its own detached thread and only touches state it shares ownership of, so a hung walk can be abandoned
+void refreshCacheForDirectory(std::shared_ptr<RootScan> scan, std::shared_ptr<VisitedDirectories> visitedDirectories, bool printProgress) {
+	const std::string& path = scan->root;
+
+	// Unregister the walk when its thread ends, however late that is for an abandoned one
+	struct WalkRegistration {
+		RootScan& scan;
+		~WalkRegistration() {
+			bool abandoned;
+			{
+				std::lock_guard<std::mutex> lock(scan.mutex);
+				abandoned = scan.abandoned.load();
+			}
+			std::lock_guard<std::mutex> lock(walkingRootsMutex);
+			walkingRoots.erase(scan.root);
+			if (abandoned) {
+				--abandonedWalks;
+			}
+		}
+	} registration{*scan};
+	if (printProgress) {
 		std::cout << "\033[1;93mProcessing directory path: '" << path << "'.\033[0m"<< std::endl;
 	}
 
 	std::vector<std::string> newIsoFiles;
+	std::set<std::string> newErrorMessages;
 
-	// Perform the cache refresh for the directory (e.g., using parallelTraverse)
-	traverse(path, newIsoFiles, uniqueErrorMessages);
+	// Compile the prune rules that apply below this root
+	PruneRules pruneRules = compilePruneRules(path);
 
-	// Use a separate mutex for read/write access to allIsoFiles
-	std::mutex allIsoFilesMutex;
+	// Perform the cache refresh for the directory at background I/O and CPU priority
+	enterBackgroundPriority();
+	const bool walked = traverse(path, newIsoFiles, newErrorMessages, *visitedDirectories, pruneRules, *scan);
+	leaveBackgroundPriority();
+
+	// A walk that was abandoned meanwhile already had its partial results kept by the waiter
+	{
+		std::lock_guard<std::mutex> lock(scan->mutex);
+		if (scan->abandoned.load()) {
+			scan->finished = true;
+			return;
+		}
+		// A root that was not walked found nothing about its shard, which is left as it is
+		if (!walked) {
+			scan->errorMessages = std::move(newErrorMessages);
+			scan->saveSuccess = true;
+			scan->finished = true;
+			scan->cv.notify_all();
+			return;
+		}
+		scan->saving = true;
+	}
+
+	// Replace the shard only after a complete, error-free walk, otherwise entries that were not reached are kept
+	const bool replaceShard = maxDepth < 0 && newErrorMessages.empty();
+	bool saveSuccess = saveCacheShard(path, newIsoFiles, replaceShard);
+
+	// Use a separate mutex for the gap printed before the first result, shared by all concurrent refresh tasks
+	static std::mutex gapMutex;
 
 	{
 		// Acquire lock for checking gapPrinted and potential printing
-		std::lock_guard<std::mutex> lock(allIsoFilesMutex);
-		if (!gapPrinted && promptFlag) {
+		std::lock_guard<std::mutex> lock(gapMutex);
+		if (!gapPrinted && printProgress) {
 		std::cout << "\n";
 		gapPrinted = true; // Set the flag to true
 		}
 	}
 
-	// Append new entries to allIsoFiles under lock protection
+	if (printProgress) {
+		std::cout << "\033[1;92mProcessed directory path: '" << path << "'.\033[0m" << std::endl;
+	}
+
+	// Hand the errors and the result over to the waiter
 	{
-		std::lock_guard<std::mutex> lock(allIsoFilesMutex);
-		allIsoFiles.insert(allIsoFiles.end(), newIsoFiles.begin(), newIsoFiles.end());
+		std::lock_guard<std::mutex> lock(scan->mutex);
+		scan->errorMessages = std::move(newErrorMessages);
+		scan->saveSuccess = saveSuccess;
+		scan->finished = true;
 	}
+	scan->cv.notify_all();
+}
 
-	if (promptFlag) {
-		std::cout << "\033[1;92mProcessed directory path: '" << path << "'.\033[0m" << std::endl;
+
+// Function to publish ISO files found by a running refresh so the ISO lists can use them before the cache is saved
+void publishLiveScanResults(const std::vector<std::string>& isoFiles, size_t from, RootScan& scan) {
+	std::lock_guard<std::mutex> scanLock(scan.mutex);
+	if (scan.abandoned.load()) {
+		return;
+	}
+	scan.partialIsoFiles.insert(scan.partialIsoFiles.end(), isoFiles.begin() + from, isoFiles.end());
+
+	std::lock_guard<std::mutex> lock(liveScanMutex);
+	liveScanResults.insert(liveScanResults.end(), isoFiles.begin() + from, isoFiles.end());
+}
+
+
+// Function to wait for the walk of one root, a walk without progress for stallTimeoutSeconds is abandoned and its root marked degraded
+static bool awaitRootScan(RootScan& scan, long stallTimeoutSeconds, std::set<std::string>& uniqueErrorMessages) {
+	std::unique_lock<std::mutex> lock(scan.mutex);
+	while (!scan.finished) {
+		// Without a deadline, or once the walk is writing its shard, just wait for it
+		if (stallTimeoutSeconds <= 0 || scan.saving) {
+			scan.cv.wait(lock);
+			continue;
+		}
+
+		const auto lastProgress = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(scan.lastProgressNs.load(std::memory_order_relaxed)));
+		const auto deadline = lastProgress + std::chrono::seconds(stallTimeoutSeconds);
+		if (std::chrono::steady_clock::now() < deadline) {
+			scan.cv.wait_until(lock, deadline);
+			continue;
+		}
+
+		// The walk is stuck, most likely on a stale network mount: leave its thread behind and keep what it found
+		scan.abandoned.store(true);
+		{
+			std::lock_guard<std::mutex> walkingLock(walkingRootsMutex);
+			++abandonedWalks;
+		}
+		std::vector<std::string> partialIsoFiles = std::move(scan.partialIsoFiles);
+		lock.unlock();
+
+		const int64_t backoff = markShardDegraded(scan.root, partialIsoFiles, stallTimeoutSeconds);
+		uniqueErrorMessages.insert("\n\033[1;91mScan of '" + scan.root + "' made no progress for " + std::to_string(stallTimeoutSeconds) +
+			" seconds and was abandoned, " + std::to_string(partialIsoFiles.size()) + " ISO(s) found so far were kept. Next scan of it in " +
+			std::to_string(backoff) + " seconds.\033[0;1m");
+		return true;
+	}
+
+	uniqueErrorMessages.insert(scan.errorMessages.begin(), scan.errorMessages.end());
+	return scan.saveSuccess;
+}
+
+
+// Function to walk the scan roots in parallel, each root saving its own shard, and wait for all of them
+bool runCacheRefresh(const std::vector<std::string>& scanRoots, std::set<std::string>& uniqueErrorMessages, bool printProgress) {
+	// Directories already walked during this refresh, shared by every walk including abandoned ones
+	auto visitedDirectories = std::make_shared<VisitedDirectories>();
+
+	// A walk that gets through no directory or entry for this long is treated as hung, 0 waits forever
+	const long stallTimeoutSeconds = configNumber("scan_timeout_seconds", 120);
+
+	// Live results stay visible until the last concurrent refresh has saved its results
+	{
+		std::lock_guard<std::mutex> lock(liveScanMutex);
+		++activeLiveScans;
+	}
+
+	std::vector<std::shared_ptr<RootScan>> runningScans;
+	bool saveSuccess = true;
+
+	// Start a walk on its own thread for each scan root to refresh its shard
+	for (const auto& root : scanRoots) {
+		// Roots whose last walk stalled are left alone until their backoff expires
+		const int64_t retryAfter = shardRetryAfter(root);
+		const int64_t now = static_cast<int64_t>(time(nullptr));
+		if (retryAfter > now) {
+			uniqueErrorMessages.insert("\n\033[1;93mSkipped '" + root + "': its last scan stalled, next scan of it in " + std::to_string(retryAfter - now) + " seconds.\033[0;1m");
+			continue;
+		}
+
+		// A root whose earlier walk is still alive, e.g. abandoned on a stale mount, is not walked a second time
+		{
+			std::lock_guard<std::mutex> lock(walkingRootsMutex);
+			if (!walkingRoots.insert(root).second) {
+				uniqueErrorMessages.insert("\n\033[1;93mSkipped '" + root + "': an earlier scan of it is still running (" + std::to_string(abandonedWalks) + " abandoned scan(s) still stuck).\033[0;1m");
+				continue;
+			}
+		}
+
+		auto scan = std::make_shared<RootScan>();
+		scan->root = root;
+		scan->touch();
+		std::thread(refreshCacheForDirectory, scan, visitedDirectories, printProgress).detach();
+		runningScans.push_back(std::move(scan));
+
+		// Check if the number of running walks has reached the maximum allowed
+		if (runningScans.size() >= maxThreads) {
+			// Wait for the walks to complete or stall
+			for (auto& runningScan : runningScans) {
+				saveSuccess = awaitRootScan(*runningScan, stallTimeoutSeconds, uniqueErrorMessages) && saveSuccess;
+			}
+			runningScans.clear();
+			if (printProgress) {
+				std::cout << "\n";
+			}
+			gapPrinted = false;
+		}
+	}
+
+	// Wait for the remaining walks to complete or stall
+	for (auto& runningScan : runningScans) {
+		saveSuccess = awaitRootScan(*runningScan, stallTimeoutSeconds, uniqueErrorMessages) && saveSuccess;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(liveScanMutex);
+		if (--activeLiveScans == 0) {
+			liveScanResults.clear();
+			++liveScanEpoch;
+		}
+	}
+
+	return saveSuccess;
+}
+
+
+// Function to start an import in the background, returns false if one is already running
+bool startBackgroundRefresh(const std::vector<std::string>& scanRoots) {
+	if (backgroundRefreshRunning.exchange(true)) {
+		return false;
+	}
+
+	// Reap the thread of the previous background import
+	if (backgroundRefreshThread.joinable()) {
+		backgroundRefreshThread.join();
+	}
+
+	backgroundRefreshThread = std::thread([scanRoots]() {
+		auto start_time = std::chrono::high_resolution_clock::now();
+		std::set<std::string> uniqueErrorMessages;
+
+		bool saveSuccess = runCacheRefresh(scanRoots, uniqueErrorMessages, false);
+
+		auto end_time = std::chrono::high_resolution_clock::now();
+		auto total_elapsed_time = std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count();
+
+		std::ostringstream summary;
+		if (!saveSuccess) {
+			summary << "\033[1;91mBackground import failed to save the cache.\033[0m\n";
+		} else if (!uniqueErrorMessages.empty()) {
+			summary << "\033[1;93mBackground import finished with error(s) in " << std::fixed << std::setprecision(1) << total_elapsed_time << " seconds:\033[0m";
+			for (const auto& error : uniqueErrorMessages) {
+				summary << error;
+			}
+			summary << "\033[0m\n";
+		} else {
+			summary << "\033[1;92mBackground import finished successfully in " << std::fixed << std::setprecision(1) << total_elapsed_time << " seconds.\033[0m\n";
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(liveScanMutex);
+			backgroundRefreshSummary = summary.str();
+		}
+		backgroundRefreshRunning.store(false);
+	});
+
+	return true;
+}
+
+
+// Function to print the state of a background import, the final summary is shown once
+void printBackgroundRefreshStatus(bool showSummary) {
+	std::lock_guard<std::mutex> lock(liveScanMutex);
+	if (backgroundRefreshRunning.load()) {
+		std::cout << "\033[1;93mImportISO is running in the background, " << liveScanResults.size() << " ISO(s) found so far.\033[0m\n";
+	} else if (showSummary && !backgroundRefreshSummary.empty()) {
+		std::cout << backgroundRefreshSummary;
+		backgroundRefreshSummary.clear();
+	}
+}
+
+
+// Function to wait for a background import before exiting
+void waitForBackgroundRefresh() {
+	if (backgroundRefreshRunning.load()) {
+		std::cout << "\033[1mWaiting for the background import to finish...\033[0m\n";
+	}
+	if (backgroundRefreshThread.joinable()) {
+		backgroundRefreshThread.join();
 	}
 }
 
@@ -329,9 +1159,6 @@ void manualRefreshCache(const std::string& initialDir) {
     std::istringstream iss(input);
     std::string path;
 
-    // Vector to store all ISO files from multiple directories
-    std::vector<std::string> allIsoFiles;
-
     // Vector to store valid directory paths
     std::vector<std::string> validPaths;
 
@@ -341,13 +1168,9 @@ void manualRefreshCache(const std::string& initialDir) {
     // Set to store processed invalid paths
     std::set<std::string> processedInvalidPaths;
     
-    // Set to store processed valid paths
-    std::set<std::string> processedValidPaths;
     // Vector to store ISO unique input errors
     std::set<std::string> uniqueErrorMessages;
 
-    std::vector<std::future<void>> futures;
-
     // Iterate through the entered directory paths and print invalid paths
     while (std::getline(iss, path, ';')) {
         // Check if the directory path is valid
@@ -380,51 +1203,27 @@ void manualRefreshCache(const std::string& initialDir) {
         std::cout << "\n";
     }
 
-    // Start the timer
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    // Create a task for each valid directory to refresh the cache and pass the vector by reference
-    std::istringstream iss2(input); // Reset the string stream
-    std::size_t runningTasks = 0;  // Track the number of running tasks
-        
-    while (std::getline(iss2, path, ';')) {
-        // Check if the directory path is valid
-        if (!isValidDirectory(path)) {
-            continue; // Skip invalid paths
-        }
-
-        // Check if the path has already been processed
-        if (processedValidPaths.find(path) != processedValidPaths.end()) {
-            continue; // Skip already processed valid paths
-        }
-
-        // Add a task to the thread pool for refreshing the cache for each directory
-        futures.emplace_back(std::async(std::launch::async, refreshCacheForDirectory, path, std::ref(allIsoFiles), std::ref(uniqueErrorMessages)));
-
-        ++runningTasks;
-
-        // Mark the path as processed
-        processedValidPaths.insert(path);
+    // Resolve the valid paths to distinct physical roots so overlapping input is walked only once
+    std::vector<std::string> scanRoots = normalizeScanRoots(validPaths);
 
-        // Check if the number of running tasks has reached the maximum allowed
-        if (runningTasks >= maxThreads) {
-            // Wait for the tasks to complete
-            for (auto& future : futures) {
-                future.wait();
-            }
-            // Clear completed tasks from the vector
-            futures.clear();
-            runningTasks = 0;  // Reset the count of running tasks
-            std::lock_guard<std::mutex> lock(cacheRefreshMutex);
-            std::cout << "\n";
-            gapPrinted = false;
+    // Imports from the menu run in the background, found ISOs stream into the ISO lists right away
+    if (initialDir.empty() && !scanRoots.empty()) {
+        if (startBackgroundRefresh(scanRoots)) {
+            std::cout << "\033[1;92mImport started in the background, found ISO(s) appear in the ManageISO lists as the scan progresses.\033[0m\n";
+        } else {
+            std::cout << "\033[1;93mA background import is already running, try again when it has finished.\033[0m\n";
         }
+        std::cout << "\n\033[1;32m↵ to continue...\033[0;1m";
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        promptFlag = true;
+        return;
     }
 
-    // Wait for the remaining tasks to complete
-    for (auto& future : futures) {
-        future.wait();
-    }
+    // Start the timer
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // Walk the roots and save the combined cache to disk
+    bool saveSuccess = runCacheRefresh(scanRoots, uniqueErrorMessages, promptFlag);
     
     for (const auto& error : uniqueErrorMessages) {
         std::cout << error;
@@ -433,9 +1232,6 @@ void manualRefreshCache(const std::string& initialDir) {
     if (!uniqueErrorMessages.empty()) {
 		std::cout << "\n";
 	}
-    
-    // Save the combined cache to disk
-    bool saveSuccess = saveCache(allIsoFiles, maxCacheSize);
 
     // Stop the timer after completing the cache refresh and removal of non-existent paths
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -489,52 +1285,147 @@ bool iequals(const std::string_view& a, const std::string_view& b) {
 }
 
 
-// Function to traverse a directory and find ISO files
-void traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages) {
-    try {
-        // Set directory traversal options; initially none
-        auto options = std::filesystem::directory_options::none;
+// Directory entry collected during a readdir pass and stat'ed later in inode order
+struct ScanEntry {
+    ino_t inode;
+    unsigned char type;
+    std::pmr::string name;     // Built in the walker's arena
+};
+
+
+// Function to check for a ".iso" extension without building a path object
+static bool hasIsoExtension(std::string_view name) {
+    return name.size() > 4 && iequals(name.substr(name.size() - 4), ".iso");
+}
+
+
+// Function to traverse a directory and find ISO files, returns false if the root was not walked
+bool traverse(const std::filesystem::path& path, std::vector<std::string>& isoFiles, std::set<std::string>& uniqueErrorMessages, VisitedDirectories& visitedDirectories, const PruneRules& pruneRules, RootScan& scan) {
+    const std::string rootString = path.string();
+    
+    // Skip the root entirely if another walker already reached it (e.g. through a bind mount)
+    struct stat rootStat;
+    if (stat(rootString.c_str(), &rootStat) != 0) {
+        uniqueErrorMessages.insert("\n\033[1;91mCannot access '" + rootString + "': " + strerror(errno) + ".\033[0;1m");
+        return false;
+    }
+    if (!markDirectoryVisited(visitedDirectories, rootStat, 0)) {
+        return false;
+    }
+    
+    // If maxDepth is non-negative, include symlink directories in traversal
+    const bool followSymlinks = maxDepth >= 0;
+    
+    // Length of the root prefix stripped to get paths relative to the root
+    const size_t rootPrefixLength = rootString.size() + (rootString.back() == '/' ? 0 : 1);
+    
+    // Directories waiting to be read, with the depth of their entries
+    std::vector<std::pair<std::string, int>> pendingDirectories{{rootString, 0}};
+    std::vector<std::pair<std::string, int>> subdirectories;
+    
+    // Listings of one directory are built in this walker's arena, which is reset before the next directory
+    ScratchArena arena;
+    
+    // Path buffers reused for every entry, only paths that are kept get their own allocation
+    std::string entryName;
+    std::string entryPath;
+    std::string relativePath;
+    
+    while (!pendingDirectories.empty()) {
+        // Stop once the waiter gave up on this walk, e.g. after a stale mount came back
+        if (scan.abandoned.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        auto [dirPath, depth] = std::move(pendingDirectories.back());
+        pendingDirectories.pop_back();
+        arena.release();
+        std::pmr::vector<ScanEntry> entries(arena.get());
         
-        // If maxDepth is non-negative, include symlink directories in traversal
-        if (maxDepth >= 0) {
-            options |= std::filesystem::directory_options::follow_directory_symlink;
+        throttleBackgroundIo();
+        DIR* dir = opendir(dirPath.c_str());
+        if (dir == nullptr) {
+            uniqueErrorMessages.insert("\n\033[1;91mCannot open directory '" + dirPath + "': " + strerror(errno) + ".\033[0;1m");
+            continue;
         }
+        const int dirFd = dirfd(dir);
+        scan.touch();
         
-        // Iterate through the directory recursively
-        for (auto it = std::filesystem::recursive_directory_iterator(path, options); it != std::filesystem::recursive_directory_iterator(); ++it) {
-            // If maxDepth is set and current depth exceeds it, skip further recursion
-            if (maxDepth >= 0 && it.depth() > maxDepth) {
-                it.disable_recursion_pending();
+        // First pass: readdir only, keeping the entries that may need a stat
+        struct dirent* dirEntry;
+        while ((dirEntry = readdir(dir)) != nullptr) {
+            const char* name = dirEntry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
                 continue;
             }
             
-            const auto& entry = *it;
-            // If the current entry is not a regular file, skip it
-            if (!entry.is_regular_file()) {
-                continue;
+            const unsigned char type = dirEntry->d_type;
+            bool isIsoName = hasIsoExtension(name);
+            if (type == DT_DIR || type == DT_UNKNOWN || (type == DT_REG && isIsoName) || (type == DT_LNK && (isIsoName || followSymlinks))) {
+                entries.push_back({dirEntry->d_ino, type, std::pmr::string(name, arena.get())});
             }
+        }
+        
+        // Second pass: stat in inode order so cold scans walk the inode tables sequentially instead of seeking
+        std::sort(entries.begin(), entries.end(), [](const ScanEntry& a, const ScanEntry& b) { return a.inode < b.inode; });
+        
+        const std::string dirPrefix = (dirPath.back() == '/') ? dirPath : dirPath + "/";
+        const size_t foundBefore = isoFiles.size();
+        subdirectories.clear();
+        for (const auto& entry : entries) {
+            bool isSymlink = entry.type == DT_LNK;
+            struct stat entryStat;
+            throttleBackgroundIo();
+            scan.touch();
             
-            const auto& filePath = entry.path();
-            const auto extension = filePath.extension();
-            
-            // Skip files that do not have a ".iso" extension
-            if (!iequals(extension.string(), ".iso")) {
-                continue;
+            if (entry.type == DT_UNKNOWN) {
+                if (fstatat(dirFd, entry.name.c_str(), &entryStat, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                isSymlink = S_ISLNK(entryStat.st_mode);
             }
-            
-            const auto fileSize = entry.file_size();
-            // Skip files smaller than 5 MB or with a size of 0
-            if (fileSize < 5 * 1024 * 1024 || fileSize == 0) {
-                continue;
+            if ((entry.type != DT_UNKNOWN || isSymlink) && fstatat(dirFd, entry.name.c_str(), &entryStat, 0) != 0) {
+                continue; // Vanished entry or dangling symlink
             }
             
-            // Add valid .iso file paths to the isoFiles vector
-            isoFiles.push_back(filePath.string());
+            entryName.assign(entry.name);
+            entryPath.assign(dirPrefix).append(entryName);
+            
+            if (S_ISDIR(entryStat.st_mode)) {
+                // Only recurse while the entries below stay within maxDepth
+                if ((isSymlink && !followSymlinks) || (maxDepth >= 0 && depth + 1 > maxDepth)) {
+                    continue;
+                }
+                
+                // Prune excluded, foreign or already walked directories before they are opened
+                relativePath.assign(entryPath, rootPrefixLength);
+                if (shouldDescend(entryName, relativePath, entryStat, depth + 1, pruneRules, visitedDirectories)) {
+                    subdirectories.emplace_back(entryPath, depth + 1);
+                }
+            } else if (S_ISREG(entryStat.st_mode) && hasIsoExtension(entryName)) {
+                // Skip files smaller than 5 MB or with a size of 0
+                if (entryStat.st_size < 5 * 1024 * 1024) {
+                    continue;
+                }
+                
+                // Skip files matched by the prune rules
+                relativePath.assign(entryPath, rootPrefixLength);
+                if (isPruned(pruneRules, relativePath, entryName, false)) {
+                    continue;
+                }
+                
+                // Add valid .iso file paths to the isoFiles vector
+                isoFiles.push_back(entryPath);
+            }
+        }
+        closedir(dir);
+        
+        // Make this directory's ISO files visible to the ISO lists while the scan goes on
+        if (isoFiles.size() > foundBefore) {
+            publishLiveScanResults(isoFiles, foundBefore, scan);
         }
-    } catch (const std::filesystem::filesystem_error& e) {
-        // Catch any filesystem errors, format the error message, and add it to the set of unique error messages
-        std::string formattedError = std::string("\n\033[1;91m") + e.what() + ".\033[0;1m";
-        uniqueErrorMessages.insert(formattedError);
+        
+        // Walk subdirectories in inode order as well
+        pendingDirectories.insert(pendingDirectories.end(), std::make_move_iterator(subdirectories.rbegin()), std::make_move_iterator(subdirectories.rend()));
     }
+    return true;
 }
-
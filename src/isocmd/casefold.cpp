@@ -0,0 +1,375 @@
+#include "../headers.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// Unicode simple case folding for UTF-8 names, locale independent
+
+
+// One run of code points folded by a fixed offset; with stride 2 only every other code point (starting at first) folds
+struct CaseFoldRange {
+    char32_t first;
+    char32_t last;
+    int32_t delta;
+    uint8_t stride;
+};
+
+
+// Simple case folding (CaseFolding.txt status C and S) of every bicameral script, sorted by first
+static constexpr CaseFoldRange caseFoldRanges[] = {
+    {0x00B5, 0x00B5, 0x03BC - 0x00B5, 1},  // Micro sign
+    {0x00C0, 0x00D6, 0x20, 1},
+    {0x00D8, 0x00DE, 0x20, 1},
+    {0x0100, 0x012F, 1, 2},
+    {0x0132, 0x0137, 1, 2},
+    {0x0139, 0x0148, 1, 2},
+    {0x014A, 0x0177, 1, 2},
+    {0x0178, 0x0178, 0x00FF - 0x0178, 1},
+    {0x0179, 0x017E, 1, 2},
+    {0x017F, 0x017F, 's' - 0x017F, 1},     // Long s
+    {0x0181, 0x0181, 0x0253 - 0x0181, 1},
+    {0x0182, 0x0185, 1, 2},
+    {0x0186, 0x0186, 0x0254 - 0x0186, 1},
+    {0x0187, 0x0187, 1, 1},
+    {0x0189, 0x018A, 0x0256 - 0x0189, 1},
+    {0x018B, 0x018B, 1, 1},
+    {0x018E, 0x018E, 0x01DD - 0x018E, 1},
+    {0x018F, 0x018F, 0x0259 - 0x018F, 1},
+    {0x0190, 0x0190, 0x025B - 0x0190, 1},
+    {0x0191, 0x0191, 1, 1},
+    {0x0193, 0x0193, 0x0260 - 0x0193, 1},
+    {0x0194, 0x0194, 0x0263 - 0x0194, 1},
+    {0x0196, 0x0196, 0x0269 - 0x0196, 1},
+    {0x0197, 0x0197, 0x0268 - 0x0197, 1},
+    {0x0198, 0x0198, 1, 1},
+    {0x019C, 0x019C, 0x026F - 0x019C, 1},
+    {0x019D, 0x019D, 0x0272 - 0x019D, 1},
+    {0x019F, 0x019F, 0x0275 - 0x019F, 1},
+    {0x01A0, 0x01A5, 1, 2},
+    {0x01A6, 0x01A6, 0x0280 - 0x01A6, 1},
+    {0x01A7, 0x01A7, 1, 1},
+    {0x01A9, 0x01A9, 0x0283 - 0x01A9, 1},
+    {0x01AC, 0x01AC, 1, 1},
+    {0x01AE, 0x01AE, 0x0288 - 0x01AE, 1},
+    {0x01AF, 0x01AF, 1, 1},
+    {0x01B1, 0x01B2, 0x028A - 0x01B1, 1},
+    {0x01B3, 0x01B5, 1, 2},
+    {0x01B7, 0x01B7, 0x0292 - 0x01B7, 1},
+    {0x01B8, 0x01B8, 1, 1},
+    {0x01BC, 0x01BC, 1, 1},
+    {0x01C4, 0x01C4, 2, 1},
+    {0x01C5, 0x01C5, 1, 1},
+    {0x01C7, 0x01C7, 2, 1},
+    {0x01C8, 0x01C8, 1, 1},
+    {0x01CA, 0x01CA, 2, 1},
+    {0x01CB, 0x01DC, 1, 2},
+    {0x01DE, 0x01EF, 1, 2},
+    {0x01F1, 0x01F1, 2, 1},
+    {0x01F2, 0x01F4, 1, 2},
+    {0x01F6, 0x01F6, 0x0195 - 0x01F6, 1},
+    {0x01F7, 0x01F7, 0x01BF - 0x01F7, 1},
+    {0x01F8, 0x021F, 1, 2},
+    {0x0220, 0x0220, 0x019E - 0x0220, 1},
+    {0x0222, 0x0233, 1, 2},
+    {0x023A, 0x023A, 0x2C65 - 0x023A, 1},
+    {0x023B, 0x023B, 1, 1},
+    {0x023D, 0x023D, 0x019A - 0x023D, 1},
+    {0x023E, 0x023E, 0x2C66 - 0x023E, 1},
+    {0x0241, 0x0241, 1, 1},
+    {0x0243, 0x0243, 0x0180 - 0x0243, 1},
+    {0x0244, 0x0244, 0x0289 - 0x0244, 1},
+    {0x0245, 0x0245, 0x028C - 0x0245, 1},
+    {0x0246, 0x024F, 1, 2},
+    {0x0345, 0x0345, 0x03B9 - 0x0345, 1},  // Combining ypogegrammeni
+    {0x0370, 0x0373, 1, 2},
+    {0x0376, 0x0376, 1, 1},
+    {0x037F, 0x037F, 0x03F3 - 0x037F, 1},
+    {0x0386, 0x0386, 0x03AC - 0x0386, 1},
+    {0x0388, 0x038A, 0x03AD - 0x0388, 1},
+    {0x038C, 0x038C, 0x03CC - 0x038C, 1},
+    {0x038E, 0x038F, 0x03CD - 0x038E, 1},
+    {0x0391, 0x03A1, 0x20, 1},
+    {0x03A3, 0x03AB, 0x20, 1},
+    {0x03C2, 0x03C2, 1, 1},                // Final sigma
+    {0x03CF, 0x03CF, 0x03D7 - 0x03CF, 1},
+    {0x03D0, 0x03D0, 0x03B2 - 0x03D0, 1},
+    {0x03D1, 0x03D1, 0x03B8 - 0x03D1, 1},
+    {0x03D5, 0x03D5, 0x03C6 - 0x03D5, 1},
+    {0x03D6, 0x03D6, 0x03C0 - 0x03D6, 1},
+    {0x03D8, 0x03EF, 1, 2},
+    {0x03F0, 0x03F0, 0x03BA - 0x03F0, 1},
+    {0x03F1, 0x03F1, 0x03C1 - 0x03F1, 1},
+    {0x03F4, 0x03F4, 0x03B8 - 0x03F4, 1},
+    {0x03F5, 0x03F5, 0x03B5 - 0x03F5, 1},
+    {0x03F7, 0x03F7, 1, 1},
+    {0x03F9, 0x03F9, 0x03F2 - 0x03F9, 1},
+    {0x03FA, 0x03FA, 1, 1},
+    {0x03FD, 0x03FF, 0x037B - 0x03FD, 1},
+    {0x0400, 0x040F, 0x50, 1},
+    {0x0410, 0x042F, 0x20, 1},
+    {0x0460, 0x0481, 1, 2},
+    {0x048A, 0x04BF, 1, 2},
+    {0x04C0, 0x04C0, 0x04CF - 0x04C0, 1},
+    {0x04C1, 0x04CE, 1, 2},
+    {0x04D0, 0x052F, 1, 2},
+    {0x0531, 0x0556, 0x30, 1},
+    {0x10A0, 0x10C5, 0x2D00 - 0x10A0, 1},  // Georgian capitals
+    {0x10C7, 0x10C7, 0x2D27 - 0x10C7, 1},
+    {0x10CD, 0x10CD, 0x2D2D - 0x10CD, 1},
+    {0x13F8, 0x13FD, -8, 1},               // Cherokee small letters fold to capitals
+    {0x1C80, 0x1C80, 0x0432 - 0x1C80, 1},  // Cyrillic extended-C
+    {0x1C81, 0x1C81, 0x0434 - 0x1C81, 1},
+    {0x1C82, 0x1C82, 0x043E - 0x1C82, 1},
+    {0x1C83, 0x1C84, 0x0441 - 0x1C83, 1},
+    {0x1C85, 0x1C85, 0x0442 - 0x1C85, 1},
+    {0x1C86, 0x1C86, 0x044A - 0x1C86, 1},
+    {0x1C87, 0x1C87, 0x0463 - 0x1C87, 1},
+    {0x1C88, 0x1C88, 0xA64B - 0x1C88, 1},
+    {0x1C90, 0x1CBA, 0x10D0 - 0x1C90, 1},  // Georgian Mtavruli
+    {0x1CBD, 0x1CBF, 0x10FD - 0x1CBD, 1},
+    {0x1E00, 0x1E95, 1, 2},
+    {0x1E9B, 0x1E9B, 0x1E61 - 0x1E9B, 1},
+    {0x1E9E, 0x1E9E, 0x00DF - 0x1E9E, 1},  // Capital sharp s
+    {0x1EA0, 0x1EFF, 1, 2},
+    {0x1F08, 0x1F0F, -8, 1},               // Greek extended
+    {0x1F18, 0x1F1D, -8, 1},
+    {0x1F28, 0x1F2F, -8, 1},
+    {0x1F38, 0x1F3F, -8, 1},
+    {0x1F48, 0x1F4D, -8, 1},
+    {0x1F59, 0x1F5F, -8, 2},
+    {0x1F68, 0x1F6F, -8, 1},
+    {0x1FB8, 0x1FB9, -8, 1},
+    {0x1FBA, 0x1FBB, 0x1F70 - 0x1FBA, 1},
+    {0x1FBE, 0x1FBE, 0x03B9 - 0x1FBE, 1},
+    {0x1FC8, 0x1FCB, 0x1F72 - 0x1FC8, 1},
+    {0x1FD8, 0x1FD9, -8, 1},
+    {0x1FDA, 0x1FDB, 0x1F76 - 0x1FDA, 1},
+    {0x1FE8, 0x1FE9, -8, 1},
+    {0x1FEA, 0x1FEB, 0x1F7A - 0x1FEA, 1},
+    {0x1FEC, 0x1FEC, 0x1FE5 - 0x1FEC, 1},
+    {0x1FF8, 0x1FF9, 0x1F78 - 0x1FF8, 1},
+    {0x1FFA, 0x1FFB, 0x1F7C - 0x1FFA, 1},
+    {0x2126, 0x2126, 0x03C9 - 0x2126, 1},  // Ohm sign
+    {0x212A, 0x212A, 'k' - 0x212A, 1},     // Kelvin sign
+    {0x212B, 0x212B, 0x00E5 - 0x212B, 1},  // Angstrom sign
+    {0x2132, 0x2132, 0x214E - 0x2132, 1},
+    {0x2160, 0x216F, 0x10, 1},             // Roman numerals
+    {0x2183, 0x2183, 1, 1},
+    {0x24B6, 0x24CF, 26, 1},               // Circled letters
+    {0x2C00, 0x2C2F, 0x30, 1},             // Glagolitic
+    {0x2C60, 0x2C60, 1, 1},
+    {0x2C62, 0x2C62, 0x026B - 0x2C62, 1},
+    {0x2C63, 0x2C63, 0x1D7D - 0x2C63, 1},
+    {0x2C64, 0x2C64, 0x027D - 0x2C64, 1},
+    {0x2C67, 0x2C6C, 1, 2},
+    {0x2C6D, 0x2C6D, 0x0251 - 0x2C6D, 1},
+    {0x2C6E, 0x2C6E, 0x0271 - 0x2C6E, 1},
+    {0x2C6F, 0x2C6F, 0x0250 - 0x2C6F, 1},
+    {0x2C70, 0x2C70, 0x0252 - 0x2C70, 1},
+    {0x2C72, 0x2C72, 1, 1},
+    {0x2C75, 0x2C75, 1, 1},
+    {0x2C7E, 0x2C7F, 0x023F - 0x2C7E, 1},
+    {0x2C80, 0x2CE3, 1, 2},                // Coptic
+    {0x2CEB, 0x2CED, 1, 2},
+    {0x2CF2, 0x2CF2, 1, 1},
+    {0xA640, 0xA66D, 1, 2},                // Cyrillic extended-B
+    {0xA680, 0xA69B, 1, 2},
+    {0xA722, 0xA72F, 1, 2},                // Latin extended-D
+    {0xA732, 0xA76F, 1, 2},
+    {0xA779, 0xA77C, 1, 2},
+    {0xA77D, 0xA77D, 0x1D79 - 0xA77D, 1},
+    {0xA77E, 0xA787, 1, 2},
+    {0xA78B, 0xA78B, 1, 1},
+    {0xA78D, 0xA78D, 0x0265 - 0xA78D, 1},
+    {0xA790, 0xA793, 1, 2},
+    {0xA796, 0xA7A9, 1, 2},
+    {0xA7AA, 0xA7AA, 0x0266 - 0xA7AA, 1},
+    {0xA7AB, 0xA7AB, 0x025C - 0xA7AB, 1},
+    {0xA7AC, 0xA7AC, 0x0261 - 0xA7AC, 1},
+    {0xA7AD, 0xA7AD, 0x026C - 0xA7AD, 1},
+    {0xA7AE, 0xA7AE, 0x026A - 0xA7AE, 1},
+    {0xA7B0, 0xA7B0, 0x029E - 0xA7B0, 1},
+    {0xA7B1, 0xA7B1, 0x0287 - 0xA7B1, 1},
+    {0xA7B2, 0xA7B2, 0x029D - 0xA7B2, 1},
+    {0xA7B3, 0xA7B3, 0xAB53 - 0xA7B3, 1},
+    {0xA7B4, 0xA7C2, 1, 2},
+    {0xA7C4, 0xA7C4, 0xA794 - 0xA7C4, 1},
+    {0xA7C5, 0xA7C5, 0x0282 - 0xA7C5, 1},
+    {0xA7C6, 0xA7C6, 0x1D8E - 0xA7C6, 1},
+    {0xA7C7, 0xA7C9, 1, 2},
+    {0xA7D0, 0xA7D0, 1, 1},
+    {0xA7D6, 0xA7D8, 1, 2},
+    {0xA7F5, 0xA7F5, 1, 1},
+    {0xAB70, 0xABBF, 0x13A0 - 0xAB70, 1},  // Cherokee small letters
+    {0xFF21, 0xFF3A, 0x20, 1},             // Fullwidth Latin capitals
+    {0x10400, 0x10427, 0x28, 1},           // Deseret
+    {0x104B0, 0x104D3, 0x28, 1},           // Osage
+    {0x10570, 0x1057A, 0x27, 1},           // Vithkuqi
+    {0x1057C, 0x1058A, 0x27, 1},
+    {0x1058C, 0x10592, 0x27, 1},
+    {0x10594, 0x10595, 0x27, 1},
+    {0x10C80, 0x10CB2, 0x40, 1},           // Old Hungarian
+    {0x118A0, 0x118BF, 0x20, 1},           // Warang Citi
+    {0x16E40, 0x16E5F, 0x20, 1},           // Medefaidrin
+    {0x1E900, 0x1E921, 0x22, 1},           // Adlam
+};
+
+
+// Simple case fold of one code point, binary search over the range table
+static char32_t foldCodePoint(char32_t codePoint) {
+    size_t low = 0;
+    size_t high = sizeof(caseFoldRanges) / sizeof(caseFoldRanges[0]);
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        const CaseFoldRange& range = caseFoldRanges[middle];
+        if (codePoint < range.first) {
+            high = middle;
+        } else if (codePoint > range.last) {
+            low = middle + 1;
+        } else {
+            if (range.stride == 2 && ((codePoint - range.first) & 1) != 0) {
+                return codePoint;
+            }
+            return static_cast<char32_t>(static_cast<int32_t>(codePoint) + range.delta);
+        }
+    }
+    return codePoint;
+}
+
+
+// Decode one UTF-8 sequence, invalid or truncated bytes are returned as a single byte (length 1, codePoint 0xFFFFFFFF)
+static size_t decodeUtf8(const unsigned char* bytes, size_t available, char32_t& codePoint) {
+    unsigned char lead = bytes[0];
+    size_t length;
+    char32_t value;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        value = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        value = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        value = lead & 0x07;
+    } else {
+        codePoint = 0xFFFFFFFF;
+        return 1;
+    }
+    if (length > available) {
+        codePoint = 0xFFFFFFFF;
+        return 1;
+    }
+    for (size_t i = 1; i < length; ++i) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            codePoint = 0xFFFFFFFF;
+            return 1;
+        }
+        value = (value << 6) | (bytes[i] & 0x3F);
+    }
+    // Reject overlong forms and surrogates, they are copied through byte by byte
+    if ((length == 3 && value < 0x800) || (length == 4 && (value < 0x10000 || value > 0x10FFFF)) || (value >= 0xD800 && value <= 0xDFFF)) {
+        codePoint = 0xFFFFFFFF;
+        return 1;
+    }
+    codePoint = value;
+    return length;
+}
+
+
+static size_t encodeUtf8(char32_t codePoint, char* out) {
+    if (codePoint < 0x80) {
+        out[0] = static_cast<char>(codePoint);
+        return 1;
+    }
+    if (codePoint < 0x800) {
+        out[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+        out[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if (codePoint < 0x10000) {
+        out[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+        out[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+    out[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+
+// Fold ASCII bytes until the first non-ASCII byte, 16 bytes at a time where SSE2 is available
+static size_t foldAsciiPrefix(const unsigned char* in, size_t length, char* out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (_mm_movemask_epi8(block) != 0) {
+            break; // Block holds a multibyte sequence, finish it byte by byte
+        }
+        __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(block, beforeA), _mm_cmplt_epi8(block, afterZ));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(block, _mm_and_si128(isUpper, caseBit)));
+    }
+#endif
+    for (; i < length && in[i] < 0x80; ++i) {
+        unsigned char c = in[i];
+        out[i] = static_cast<char>((c >= 'A' && c <= 'Z') ? c | 0x20 : c);
+    }
+    return i;
+}
+
+
+// Function to case fold UTF-8 text into out, which must hold foldedCapacity(text.size()) bytes; returns the folded length
+size_t foldCaseUtf8(std::string_view text, char* out) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(text.data());
+    const size_t length = text.size();
+    size_t read = 0;
+    size_t written = 0;
+    while (read < length) {
+        size_t ascii = foldAsciiPrefix(in + read, length - read, out + written);
+        read += ascii;
+        written += ascii;
+        if (read >= length) {
+            break;
+        }
+        if (in[read] < 0x80) {
+            continue;
+        }
+
+        char32_t codePoint;
+        size_t sequenceLength = decodeUtf8(in + read, length - read, codePoint);
+        if (codePoint == 0xFFFFFFFF) {
+            out[written++] = static_cast<char>(in[read++]);
+            continue;
+        }
+        char32_t folded = foldCodePoint(codePoint);
+        if (folded == codePoint) {
+            std::memcpy(out + written, in + read, sequenceLength);
+            written += sequenceLength;
+        } else {
+            written += encodeUtf8(folded, out + written);
+        }
+        read += sequenceLength;
+    }
+    return written;
+}
+
+
+// Upper bound of the folded size, a 2-byte code point folds to at most 3 bytes
+size_t foldedCapacity(size_t length) {
+    return length + length / 2 + 1;
+}
+
+
+// Function to return the case folded form of UTF-8 text
+std::string foldCase(std::string_view text) {
+    std::string folded(foldedCapacity(text.size()), '\0');
+    folded.resize(foldCaseUtf8(text, folded.data()));
+    return folded;
+}
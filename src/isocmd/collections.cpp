@@ -0,0 +1,264 @@
+#include "../headers.h"
+
+
+// COLLECTIONS STUFF
+
+// Saved searches whose members are materialized next to the catalog shards and updated as shards gain or lose entries
+const std::string collectionDirectory = std::string(std::getenv("HOME")) + "/.cache/iso_commander_collections"; // One collection per file
+const std::string collectionMagic = "#isocmd-collection 1";
+
+// Serializes read-modify-write cycles of the collection files within this process
+static std::mutex collectionsMutex;
+
+
+// One saved search and the catalog entries it currently matches
+struct Collection {
+    std::string name;
+    std::string query;
+    std::vector<std::string> members;   // Sorted, without duplicates
+};
+
+
+// Holds an exclusive flock on the collection directory, so updates of other processes do not interleave
+struct CollectionDirectoryLock {
+    int fd;
+
+    CollectionDirectoryLock() : fd(open((collectionDirectory + "/.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+        if (fd != -1) {
+            flock(fd, LOCK_EX);
+        }
+    }
+
+    ~CollectionDirectoryLock() {
+        if (fd != -1) {
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+    }
+};
+
+
+// Function to check a collection name, it becomes a file name
+static bool isValidCollectionName(const std::string& name) {
+    if (name.empty() || name.size() > 128 || name[0] == '.') {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '-' || c == '_' || c == '.';
+    });
+}
+
+
+static std::string collectionPath(const std::string& name) {
+    return collectionDirectory + "/" + name + ".collection";
+}
+
+
+// Function to list the names of all saved collections
+static std::vector<std::string> listCollections() {
+    std::vector<std::string> names;
+    DIR* dir = opendir(collectionDirectory.c_str());
+    if (dir == nullptr) {
+        return names;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string_view fileName(entry->d_name);
+        if (fileName.size() > 11 && fileName.substr(fileName.size() - 11) == ".collection") {
+            names.emplace_back(fileName.substr(0, fileName.size() - 11));
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+
+// Function to read one collection, the header holds the magic line and the query, the member paths follow
+static bool readCollection(const std::string& name, Collection& collection) {
+    std::ifstream file(collectionPath(name));
+    std::string line;
+    if (!file.is_open() || !std::getline(file, line) || line != collectionMagic) {
+        return false;
+    }
+
+    collection.name = name;
+    collection.members.clear();
+    while (std::getline(file, line)) {
+        if (line.rfind("query=", 0) == 0) {
+            collection.query = line.substr(6);
+        } else if (!line.empty() && line[0] == '/') {
+            collection.members.push_back(line);
+        }
+    }
+    std::sort(collection.members.begin(), collection.members.end());
+    collection.members.erase(std::unique(collection.members.begin(), collection.members.end()), collection.members.end());
+    return !collection.query.empty();
+}
+
+
+// Function to write a collection through a temporary file and rename, so readers never see it half written
+static bool writeCollection(const Collection& collection) {
+    const std::string path = collectionPath(collection.name);
+    const std::string tempPath = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(tempPath, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << collectionMagic << "\nquery=" << collection.query << "\n";
+        for (const std::string& member : collection.members) {
+            file << member << "\n";
+        }
+        file.flush();
+        if (!file.good()) {
+            file.close();
+            unlink(tempPath.c_str());
+            return false;
+        }
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// Function to apply catalog changes to every collection: only the added entries are matched against the saved queries
+void updateCollections(const std::vector<std::string>& added, const std::vector<std::string>& removed) {
+    if (added.empty() && removed.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(collectionsMutex);
+    if (!std::filesystem::is_directory(collectionDirectory)) {
+        return;
+    }
+    CollectionDirectoryLock directoryLock;
+
+    std::vector<std::string> sortedRemoved(removed);
+    std::sort(sortedRemoved.begin(), sortedRemoved.end());
+
+    for (const std::string& name : listCollections()) {
+        Collection collection;
+        if (!readCollection(name, collection)) {
+            continue;
+        }
+
+        std::vector<std::string> matched = added.empty() ? std::vector<std::string>() : filterFiles(added, collection.query);
+        std::sort(matched.begin(), matched.end());
+
+        std::vector<std::string> kept;
+        kept.reserve(collection.members.size());
+        std::set_difference(collection.members.begin(), collection.members.end(), sortedRemoved.begin(), sortedRemoved.end(), std::back_inserter(kept));
+        std::vector<std::string> members;
+        members.reserve(kept.size() + matched.size());
+        std::set_union(kept.begin(), kept.end(), matched.begin(), matched.end(), std::back_inserter(members));
+
+        if (members != collection.members) {
+            collection.members = std::move(members);
+            writeCollection(collection);
+        }
+    }
+}
+
+
+// Function to save a collection with its members matched over the whole catalog, the catalog must not change meanwhile
+static bool defineCollection(const std::string& name, const std::string& query, std::vector<std::string>& members, std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(collectionDirectory, ec);
+    if (!std::filesystem::is_directory(collectionDirectory)) {
+        error = "\033[1;91mFailed to create the collection directory " + collectionDirectory + ".\033[0;1m";
+        return false;
+    }
+
+    // Shards written after the catalog was read update only the collections that already exist, so match again until the catalog held still
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        std::vector<std::string> isoFiles;
+        CatalogGeneration before, after;
+        loadCache(isoFiles, &before);
+        members = filterFiles(isoFiles, query);
+        std::sort(members.begin(), members.end());
+        members.erase(std::unique(members.begin(), members.end()), members.end());
+
+        {
+            std::lock_guard<std::mutex> lock(collectionsMutex);
+            CollectionDirectoryLock directoryLock;
+            if (!writeCollection({name, query, members})) {
+                error = "\033[1;91mFailed to save collection '" + name + "'.\033[0;1m";
+                return false;
+            }
+        }
+
+        loadCache(isoFiles, &after);
+        if (after.shards == before.shards) {
+            break;
+        }
+    }
+    return true;
+}
+
+
+// Function to resolve a collection reference of a search query: '@name' lists its members, '@name=query' saves it first
+// and '@name=' removes it. Returns false with a message in error when there are no members to show.
+bool resolveCollection(const std::string& reference, std::vector<std::string>& members, std::string& error) {
+    members.clear();
+    const size_t equals = reference.find('=');
+    const std::string name = reference.substr(0, equals);
+    if (!isValidCollectionName(name)) {
+        error = "\033[1;91mInvalid collection name '" + name + "', use letters, digits, '-', '_' and '.'.\033[0;1m";
+        return false;
+    }
+
+    if (equals == std::string::npos) {
+        Collection collection;
+        std::lock_guard<std::mutex> lock(collectionsMutex);
+        if (!readCollection(name, collection)) {
+            std::vector<std::string> names = listCollections();
+            std::string known;
+            for (const std::string& knownName : names) {
+                known += (known.empty() ? "" : ", ") + knownName;
+            }
+            error = "\033[1;91mNo collection named '" + name + "'" + (known.empty() ? "" : " (saved: " + known + ")") + ".\033[0;1m";
+            return false;
+        }
+        members = std::move(collection.members);
+        if (members.empty()) {
+            error = "\033[1;91mCollection '" + name + "' has no ISO(s).\033[0;1m";
+            return false;
+        }
+        return true;
+    }
+
+    const std::string query = reference.substr(equals + 1);
+    if (query.empty()) {
+        std::lock_guard<std::mutex> lock(collectionsMutex);
+        if (unlink(collectionPath(name).c_str()) != 0) {
+            error = "\033[1;91mNo collection named '" + name + "'.\033[0;1m";
+        } else {
+            error = "\033[1;92mCollection '" + name + "' removed.\033[0;1m";
+        }
+        return false;
+    }
+
+    // Reject a query that does not compile before anything is saved
+    std::vector<std::string> tokens;
+    std::stringstream ss(query);
+    std::string token;
+    while (std::getline(ss, token, ';')) {
+        tokens.push_back(token);
+    }
+    if (!compileFilterQuery(tokens, error)) {
+        return false;
+    }
+
+    if (!defineCollection(name, query, members, error)) {
+        return false;
+    }
+    if (members.empty()) {
+        error = "\033[1;93mCollection '" + name + "' saved, no ISO(s) match it yet.\033[0;1m";
+        return false;
+    }
+    return true;
+}
@@ -1,103 +1,281 @@
 #include "../headers.h"
 #include "../threadpool.h"
+#include "../arena.h"
+#include "../lazydfa.h"
+#include <list>
 
 
-// Sorts items in a case-insensitive manner
+// Sorts items in a case-insensitive manner, each item is case folded once and the folded keys are compared
 void sortFilesCaseInsensitive(std::vector<std::string>& files) {
-    std::sort(files.begin(), files.end(), 
-        [](const std::string& a, const std::string& b) {
-            return strcasecmp(a.c_str(), b.c_str()) < 0;
+    std::vector<std::pair<std::string, size_t>> keys;
+    keys.reserve(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        keys.emplace_back(foldCase(files[i]), i);
+    }
+    std::sort(keys.begin(), keys.end(),
+        [&files](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) {
+            int order = a.first.compare(b.first);
+            return order != 0 ? order < 0 : files[a.second] < files[b.second];
         }
     );
-}
 
+    std::vector<std::string> sorted;
+    sorted.reserve(files.size());
+    for (const auto& key : keys) {
+        sorted.push_back(std::move(files[key.second]));
+    }
+    files = std::move(sorted);
+}
 
-// Boyer-Moore string search implementation for files
-std::vector<size_t> boyerMooreSearch(const std::string& pattern, const std::string& text) {
-    // Helper lambda to convert a string to lowercase
-    auto toLower = [](const std::string& str) {
-        std::string lowerStr = str;
-        std::transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(),
-                       [](unsigned char c){ return std::tolower(c); });
-        return lowerStr;
-    };
 
-    std::string lowerPattern = toLower(pattern);
-    std::string lowerText = toLower(text);
+// Bad character shift table of one case folded query token, built once per filter run
+struct FoldedPattern {
+    std::string text;
+    std::array<size_t, 256> shifts;
+};
 
-    std::vector<size_t> shifts(256, lowerPattern.length());
-    std::vector<size_t> matches;
 
-    for (size_t i = 0; i < lowerPattern.length() - 1; i++) {
-        shifts[static_cast<unsigned char>(lowerPattern[i])] = lowerPattern.length() - i - 1;
+static FoldedPattern makeFoldedPattern(const std::string& foldedToken) {
+    FoldedPattern pattern{foldedToken, {}};
+    pattern.shifts.fill(foldedToken.length());
+    for (size_t i = 0; i + 1 < foldedToken.length(); i++) {
+        pattern.shifts[static_cast<unsigned char>(foldedToken[i])] = foldedToken.length() - i - 1;
     }
+    return pattern;
+}
 
-    size_t patternLen = lowerPattern.length();
-    size_t textLen = lowerText.length();
 
-    size_t i = 0; // Start at the beginning of the text
+// Boyer-Moore(-Horspool) match of a prepared pattern in already case folded text, no allocations
+static bool containsFolded(const FoldedPattern& pattern, std::string_view foldedText) {
+    size_t patternLen = pattern.text.length();
+    size_t textLen = foldedText.length();
+    if (patternLen == 0) {
+        return true;
+    }
+    if (textLen < patternLen) {
+        return false;
+    }
 
+    size_t i = 0;
     while (i <= textLen - patternLen) {
         size_t skip = 0;
-        
-        // Match pattern from end to start
-        while (skip < patternLen && lowerPattern[patternLen - 1 - skip] == lowerText[i + patternLen - 1 - skip]) {
+        while (skip < patternLen && pattern.text[patternLen - 1 - skip] == foldedText[i + patternLen - 1 - skip]) {
             skip++;
         }
-        
-        // If the whole pattern was found, record the match
         if (skip == patternLen) {
-            matches.push_back(i);
+            return true;
+        }
+        i += pattern.shifts[static_cast<unsigned char>(foldedText[i + patternLen - 1])];
+    }
+    return false;
+}
+
+
+// Compiled regular expression with the lazy DFAs built for it, kept across searches so repeated queries find their states already built.
+// A LazyDfa is used by one thread at a time: matchers check one out and hand it back when they are done.
+struct CompiledRegex {
+    RegexProgram program;
+    std::mutex dfaMutex;
+    std::vector<std::unique_ptr<LazyDfa>> idleDfas;
+
+    std::unique_ptr<LazyDfa> checkoutDfa() {
+        std::lock_guard<std::mutex> lock(dfaMutex);
+        if (idleDfas.empty()) {
+            return std::make_unique<LazyDfa>(program);
+        }
+        std::unique_ptr<LazyDfa> dfa = std::move(idleDfas.back());
+        idleDfas.pop_back();
+        return dfa;
+    }
+
+    void returnDfa(std::unique_ptr<LazyDfa> dfa) {
+        std::lock_guard<std::mutex> lock(dfaMutex);
+        idleDfas.push_back(std::move(dfa));
+    }
+};
+
+
+// Compiled search query, an entry matches if any token does: plain tokens are folded substrings,
+// re: and glob: tokens are regular expressions behind a literal prefilter
+struct FilterQuery {
+    std::vector<FoldedPattern> substrings;
+    std::vector<std::shared_ptr<CompiledRegex>> regexes;
+    std::vector<FoldedPattern> prefilters;      // Required literal of each regex, empty if it has none
+};
+
+
+// Per-thread evaluator of a shared FilterQuery, borrows one lazy DFA per regex for as long as it lives
+class FilterMatcher {
+private:
+    const FilterQuery& query;
+    std::vector<std::unique_ptr<LazyDfa>> dfas;
+
+public:
+    explicit FilterMatcher(const FilterQuery& compiled) : query(compiled) {
+        dfas.reserve(query.regexes.size());
+        for (const auto& regex : query.regexes) {
+            dfas.push_back(regex->checkoutDfa());
+        }
+    }
+
+    ~FilterMatcher() {
+        for (size_t i = 0; i < dfas.size(); ++i) {
+            query.regexes[i]->returnDfa(std::move(dfas[i]));
+        }
+    }
+
+    FilterMatcher(const FilterMatcher&) = delete;
+    FilterMatcher& operator=(const FilterMatcher&) = delete;
+
+    bool matches(std::string_view foldedText) {
+        for (const FoldedPattern& pattern : query.substrings) {
+            if (containsFolded(pattern, foldedText)) {
+                return true;
+            }
         }
+        for (size_t i = 0; i < dfas.size(); ++i) {
+            if (containsFolded(query.prefilters[i], foldedText) && dfas[i]->search(foldedText)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
 
-        // Move the pattern based on the last character of the current window in the text
-        if (i + patternLen < textLen) {
-            i += shifts[static_cast<unsigned char>(lowerText[i + patternLen - 1])];
+// Message of the last query that failed to compile on this thread
+static thread_local std::string lastFilterError;
+
+
+// Recently compiled regular expressions by pattern, so their DFA states survive from one search to the next
+const size_t REGEX_CACHE_ENTRIES = 16;
+
+static std::mutex regexCacheMutex;
+static std::list<std::pair<std::string, std::shared_ptr<CompiledRegex>>> regexCacheEntries; // Most recently used first
+
+
+// Function to compile a regular expression or take it from the regex cache, returns nullptr and a reason if it is invalid
+static std::shared_ptr<CompiledRegex> compileCachedRegex(const std::string& regex, std::string& reason) {
+    {
+        std::lock_guard<std::mutex> lock(regexCacheMutex);
+        for (auto it = regexCacheEntries.begin(); it != regexCacheEntries.end(); ++it) {
+            if (it->first == regex) {
+                regexCacheEntries.splice(regexCacheEntries.begin(), regexCacheEntries, it);
+                return it->second;
+            }
+        }
+    }
+
+    auto compiled = std::make_shared<CompiledRegex>();
+    if (!compileRegex(regex, compiled->program, reason)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(regexCacheMutex);
+    regexCacheEntries.emplace_front(regex, compiled);
+    if (regexCacheEntries.size() > REGEX_CACHE_ENTRIES) {
+        regexCacheEntries.pop_back();
+    }
+    return compiled;
+}
+
+
+// Function to compile the tokens of a search query, returns nullptr and a reason if a pattern is invalid
+std::shared_ptr<const FilterQuery> compileFilterQuery(const std::vector<std::string>& tokens, std::string& error) {
+    auto query = std::make_shared<FilterQuery>();
+    std::set<std::string> substrings;
+
+    for (const std::string& token : tokens) {
+        std::string regex;
+        if (token.rfind("re:", 0) == 0) {
+            regex = token.substr(3);
+        } else if (token.rfind("glob:", 0) == 0) {
+            regex = globToRegex(token.substr(5));
         } else {
-            break;
+            substrings.insert(foldCase(token));
+            continue;
+        }
+
+        std::string reason;
+        std::shared_ptr<CompiledRegex> compiled = compileCachedRegex(regex, reason);
+        if (!compiled) {
+            error = "\033[1;91mInvalid filter pattern '" + token + "': " + reason + ".\033[0;1m";
+            return nullptr;
         }
+        query->prefilters.push_back(makeFoldedPattern(compiled->program.requiredLiteral));
+        query->regexes.push_back(std::move(compiled));
     }
 
-    return matches;
+    for (const std::string& substring : substrings) {
+        query->substrings.push_back(makeFoldedPattern(substring));
+    }
+    return query;
 }
 
 
-// Function to filter cached ISO files based on search query (case-insensitive)
-std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query) {
-    std::vector<std::string> filteredFiles;
-    std::set<std::string> queryTokens;
-    
+// Function to get and clear the error of the last filterFiles query that failed to compile
+static std::string takeFilterError() {
+    std::string error;
+    error.swap(lastFilterError);
+    return error;
+}
+
+
+// Function to explain an empty filter result: why the query did not compile or resolve, otherwise that none of items matched
+std::string emptyFilterMessage(const std::string& items) {
+    std::string error = takeFilterError();
+    return error.empty() ? "\033[1;91mNo " + items + " match the search query.\033[0;1m" : error;
+}
+
+
+// Function to split a search query into its ';' separated tokens
+static std::vector<std::string> splitQuery(const std::string& query) {
+    std::vector<std::string> queryTokens;
     std::stringstream ss(query);
     std::string token;
     while (std::getline(ss, token, ';')) {
-        std::transform(token.begin(), token.end(), token.begin(), ::tolower);
-        queryTokens.insert(token);
+        queryTokens.push_back(token);
+    }
+    return queryTokens;
+}
+
+
+// Function to run a compiled query over files in parallel, matches keep the order of files
+// folded, if given, holds the case folded form of every file and spares folding them again
+static std::vector<std::string> filterWithQuery(const std::vector<std::string>& files, const FilterQuery& query, const std::vector<std::string>* folded = nullptr) {
+    std::vector<std::string> filteredFiles;
+    if (files.empty()) {
+        return filteredFiles;
     }
 
     std::shared_mutex filterMutex;
     
     auto filterTask = [&](size_t start, size_t end) {
-        std::vector<std::string> localFilteredFiles;
+        // Folded names and match indices live in this thread's arena and are dropped together
+        ScratchArena arena;
+        std::pmr::string fileName(arena.get());
+        std::pmr::vector<size_t> localMatches(arena.get());
+        FilterMatcher matcher(query);
         for (size_t i = start; i < end; ++i) {
-            const std::string& file = files[i];
-            std::string fileName = file;
-            std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
-            
-            bool matchFound = false;
-            for (const std::string& queryToken : queryTokens) {
-                if (!boyerMooreSearch(queryToken, fileName).empty()) {
-                    matchFound = true;
-                    break;
+            if (folded != nullptr) {
+                if (matcher.matches((*folded)[i])) {
+                    localMatches.push_back(i);
                 }
+                continue;
             }
+            const std::string& file = files[i];
+            fileName.resize(foldedCapacity(file.size()));
+            fileName.resize(foldCaseUtf8(file, fileName.data()));
             
-            if (matchFound) {
-                localFilteredFiles.push_back(file);
+            if (matcher.matches(fileName)) {
+                localMatches.push_back(i);
             }
         }
         
         std::unique_lock<std::shared_mutex> lock(filterMutex);
-        filteredFiles.insert(filteredFiles.end(), localFilteredFiles.begin(), localFilteredFiles.end());
+        for (size_t index : localMatches) {
+            filteredFiles.push_back(files[index]);
+        }
     };
 
     size_t numFiles = files.size();
@@ -122,55 +300,178 @@ std::vector<std::string> filterFiles(const std::vector<std::string>& files, cons
 }
 
 
-// Boyer-Moore string search implementation for umount
-size_t boyerMooreSearchMountPoints(const std::string& haystack, const std::string& needle) {
-    size_t m = needle.length();
-    size_t n = haystack.length();
-    if (m == 0) return 0;
-    if (n == 0 || n < m) return std::string::npos;
+// Function to filter cached ISO files based on search query (case-insensitive, Unicode simple case folding)
+std::vector<std::string> filterFiles(const std::vector<std::string>& files, const std::string& query) {
+    std::string error;
+    std::shared_ptr<const FilterQuery> compiled = compileFilterQuery(splitQuery(query), error);
+    if (!compiled) {
+        lastFilterError = error;
+        return {};
+    }
+    return filterWithQuery(files, *compiled);
+}
+
+
+// Results of recent catalog searches, keyed by normalized query and valid for one catalog generation
+struct CachedQueryResult {
+    CatalogGeneration generation;
+    std::vector<std::string> matches;   // Sorted, without duplicates
+};
+
+const size_t QUERY_CACHE_ENTRIES = 32;
 
-    // Construct the bad character heuristic table
-    std::vector<int> badChar(256, -1);
-    for (size_t i = 0; i < m; ++i) {
-        badChar[needle[i]] = i;
+static std::mutex queryCacheMutex;
+static std::list<std::pair<std::string, CachedQueryResult>> queryCacheEntries; // Most recently used first
+static std::unordered_map<std::string, std::list<std::pair<std::string, CachedQueryResult>>::iterator> queryCacheIndex;
+
+
+// Case folded form of every entry of the most recently filtered catalog, folded once and shared by all queries on it
+static std::mutex foldedCatalogMutex;
+static CatalogGeneration foldedCatalogGeneration;
+static std::shared_ptr<const std::vector<std::string>> foldedCatalog;
+
+
+// Function to get the folded entries of a catalog, folding them only when its generation changed
+static std::shared_ptr<const std::vector<std::string>> foldedCatalogFor(const std::vector<std::string>& isoFiles, const CatalogGeneration& generation) {
+    std::lock_guard<std::mutex> lock(foldedCatalogMutex);
+    if (foldedCatalog && foldedCatalogGeneration == generation) {
+        return foldedCatalog;
     }
 
-    // Start searching
-    size_t shift = 0;
-    while (shift <= n - m) {
-        int j = m - 1;
-        while (j >= 0 && needle[j] == haystack[shift + j]) {
-            j--;
-        }
-        if (j < 0) {
-            return shift; // Match found
+    auto folded = std::make_shared<std::vector<std::string>>();
+    folded->reserve(isoFiles.size());
+    for (const std::string& file : isoFiles) {
+        std::string foldedName(foldedCapacity(file.size()), '\0');
+        foldedName.resize(foldCaseUtf8(file, foldedName.data()));
+        folded->push_back(std::move(foldedName));
+    }
+    foldedCatalogGeneration = generation;
+    foldedCatalog = std::move(folded);
+    return foldedCatalog;
+}
+
+
+// Function to normalize query tokens into a cache key: plain tokens folded, order and duplicates ignored
+static std::string queryCacheKey(const std::vector<std::string>& tokens) {
+    std::set<std::string> normalized;
+    for (const std::string& token : tokens) {
+        if (token.rfind("re:", 0) == 0 || token.rfind("glob:", 0) == 0) {
+            normalized.insert(token);
         } else {
-            shift += std::max(1, static_cast<int>(j - badChar[haystack[shift + j]]));
+            normalized.insert(foldCase(token));
         }
     }
-    return std::string::npos; // No match found
+    std::string key;
+    for (const std::string& token : normalized) {
+        key += token;
+        key += '\0';
+    }
+    return key;
 }
 
 
-// Function to filter mounted isoDirs using Boyer-Moore search
-void filterMountPoints(const std::vector<std::string>& isoDirs, std::vector<std::string>& filterPatterns, std::vector<std::string>& filteredIsoDirs, size_t start, size_t end) {
-std::shared_mutex filterMutex;  // Shared mutex for thread-safe access to filteredFiles
-    std::vector<std::string> localFiltered;
-    for (size_t i = start; i < end; ++i) {
-        const std::string& dir = isoDirs[i];
-        std::string dirLower = dir;
-        std::transform(dirLower.begin(), dirLower.end(), dirLower.begin(), ::tolower);
-        bool matchFound = false;
-        for (const std::string& pattern : filterPatterns) {
-            if (boyerMooreSearchMountPoints(dirLower, pattern) != std::string::npos) {
-                matchFound = true;
-                break;
+// Function to store a result as the most recently used entry, evicting the least recently used one
+static void storeQueryResult(const std::string& key, CachedQueryResult result) {
+    std::lock_guard<std::mutex> lock(queryCacheMutex);
+    auto it = queryCacheIndex.find(key);
+    if (it != queryCacheIndex.end()) {
+        queryCacheEntries.erase(it->second);
+        queryCacheIndex.erase(it);
+    }
+    queryCacheEntries.emplace_front(key, std::move(result));
+    queryCacheIndex[key] = queryCacheEntries.begin();
+    if (queryCacheEntries.size() > QUERY_CACHE_ENTRIES) {
+        queryCacheIndex.erase(queryCacheEntries.back().first);
+        queryCacheEntries.pop_back();
+    }
+}
+
+
+// Function to filter the ISO catalog loaded by loadCache, repeated queries are answered from the query cache.
+// A result of the same generation is reused as is; when only live import results were appended since, just those are filtered.
+// Queries starting with '@' refer to saved collections, whose members are kept up to date without a filtering pass.
+std::vector<std::string> filterCatalog(const std::vector<std::string>& isoFiles, const CatalogGeneration& generation, const std::string& query) {
+    if (!query.empty() && query[0] == '@') {
+        std::vector<std::string> members;
+        std::string error;
+        if (!resolveCollection(query.substr(1), members, error)) {
+            lastFilterError = error;
+        }
+        return members;
+    }
+
+    const std::vector<std::string> tokens = splitQuery(query);
+    const std::string key = queryCacheKey(tokens);
+
+    // The list no longer is the catalog the generation describes, e.g. it was replaced by a filtered one
+    if (isoFiles.size() != generation.entries) {
+        return filterFiles(isoFiles, query);
+    }
+
+    CachedQueryResult cached;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(queryCacheMutex);
+        auto it = queryCacheIndex.find(key);
+        if (it != queryCacheIndex.end()) {
+            queryCacheEntries.splice(queryCacheEntries.begin(), queryCacheEntries, it->second);
+            if (it->second->second.generation == generation) {
+                return it->second->second.matches;
             }
+            cached = it->second->second;
+            found = true;
         }
-        if (matchFound) {
-            localFiltered.push_back(dir);
+    }
+
+    std::string error;
+    std::shared_ptr<const FilterQuery> compiled = compileFilterQuery(tokens, error);
+    if (!compiled) {
+        lastFilterError = error;
+        return {};
+    }
+
+    // Same shards and live epoch, more live results: filter the appended ones and merge them in
+    std::vector<std::string> appended;
+    if (found && cached.generation.shards == generation.shards && cached.generation.liveEpoch == generation.liveEpoch &&
+        cached.generation.liveCount <= generation.liveCount && liveScanResultsSince(generation, cached.generation.liveCount, appended)) {
+        std::vector<std::string> newMatches = filterWithQuery(appended, *compiled);
+        std::sort(newMatches.begin(), newMatches.end());
+        std::vector<std::string> merged;
+        merged.reserve(cached.matches.size() + newMatches.size());
+        std::set_union(cached.matches.begin(), cached.matches.end(), newMatches.begin(), newMatches.end(), std::back_inserter(merged));
+        cached.matches = std::move(merged);
+        cached.generation = generation;
+        storeQueryResult(key, cached);
+        return cached.matches;
+    }
+
+    const std::shared_ptr<const std::vector<std::string>> folded = foldedCatalogFor(isoFiles, generation);
+    CachedQueryResult result{generation, filterWithQuery(isoFiles, *compiled, folded.get())};
+    std::sort(result.matches.begin(), result.matches.end());
+    result.matches.erase(std::unique(result.matches.begin(), result.matches.end()), result.matches.end());
+    storeQueryResult(key, result);
+    return result.matches;
+}
+
+
+// Function to filter mounted isoDirs with a compiled query
+void filterMountPoints(const std::vector<std::string>& isoDirs, const FilterQuery& query, std::vector<std::string>& filteredIsoDirs, size_t start, size_t end) {
+static std::shared_mutex filterMutex;  // Shared mutex for thread-safe access to filteredFiles, shared by all calling threads
+    // Folded paths and match indices live in this thread's arena and are dropped together
+    ScratchArena arena;
+    std::pmr::string dirFolded(arena.get());
+    std::pmr::vector<size_t> localMatches(arena.get());
+    FilterMatcher matcher(query);
+    for (size_t i = start; i < end; ++i) {
+        const std::string& dir = isoDirs[i];
+        dirFolded.resize(foldedCapacity(dir.size()));
+        dirFolded.resize(foldCaseUtf8(dir, dirFolded.data()));
+        if (matcher.matches(dirFolded)) {
+            localMatches.push_back(i);
         }
     }
     std::unique_lock<std::shared_mutex> lock(filterMutex);
-    filteredIsoDirs.insert(filteredIsoDirs.end(), localFiltered.begin(), localFiltered.end());
+    for (size_t index : localMatches) {
+        filteredIsoDirs.push_back(isoDirs[index]);
+    }
 }
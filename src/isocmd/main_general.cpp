@@ -1,8 +1,8 @@
 #include "../headers.h"
 
  
-// Get max available CPU cores for global use, fallback is 2 cores
-unsigned int maxThreads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 2;
+// Get max available CPU cores for global use, honouring the affinity mask and cgroup CPU quota
+unsigned int maxThreads = availableCpuCount();
 
 // Mutex for LowLevel functions
 std::mutex Mutex4Low;
@@ -19,6 +19,12 @@ bool historyPattern = false;
 const std::string historyFilePath = std::string(getenv("HOME")) + "/.cache/iso_commander_history_cache.txt";
 const std::string historyPatternFilePath = std::string(getenv("HOME")) + "/.cache/iso_commander_pattern_cache.txt";
 
+// Optional user configuration, one 'key = value' per line, '#' starts a comment
+const std::string configFilePath = std::string(getenv("HOME")) + "/.cache/iso_commander_config.txt";
+
+// Parsed configuration entries
+static std::unordered_map<std::string, std::string> configEntries;
+
 //Maximum number of history entries at a time
 const int MAX_HISTORY_LINES = 100;
 
@@ -57,6 +63,16 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Load optional user configuration
+    loadConfig();
+
+    // Detach loop devices and remove mount points left behind by crashes or lazy unmounts
+    std::set<std::string> reclaimedMessages;
+    reclaimOrphanedLoopDevices(reclaimedMessages);
+
+    // Free the space of ISOs deleted into the trash once their retention period is over
+    startTrashReclaimer();
+
     // Register signal handlers
     signal(SIGINT, signalHandler);  // Handle Ctrl+C
     signal(SIGTERM, signalHandler); // Handle termination signals
@@ -67,6 +83,8 @@ int main(int argc, char *argv[]) {
     while (!exitProgram) {
         clearScrollBuffer();
         print_ascii();
+        // Report a running or just finished background import
+        printBackgroundRefreshStatus(true);
         // Display the main menu options
         printMenu();
 
@@ -106,6 +124,10 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Let a background import save its results before the process exits
+    waitForBackgroundRefresh();
+    stopTrashReclaimer();
+
     close(lockFileDescriptor); // Close the file descriptor, releasing the lock
     unlink(lockFile); // Remove the lock file
     return 0;
@@ -298,6 +320,8 @@ void clearScrollBuffer() {
 void signalHandler(int signum) {
     
     clearScrollBuffer();
+    // Converters and umounts run in their own process groups, Ctrl+C does not reach them
+    killWatchedProcesses();
     // Perform cleanup before exiting
     if (lockFileDescriptor != -1) {
         close(lockFileDescriptor);
@@ -307,6 +331,175 @@ void signalHandler(int signum) {
 }
 
 
+// Function to load the optional configuration file
+void loadConfig() {
+    configEntries.clear();
+
+    std::ifstream file(configFilePath);
+    if (!file.is_open()) {
+        return;
+    }
+
+    auto trim = [](std::string str) {
+        size_t start = str.find_first_not_of(" \t\r");
+        size_t end = str.find_last_not_of(" \t\r");
+        return (start == std::string::npos) ? std::string() : str.substr(start, end - start + 1);
+    };
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t equalPos = line.find('=');
+        if (equalPos == std::string::npos) {
+            continue;
+        }
+
+        std::string key = trim(line.substr(0, equalPos));
+        if (!key.empty()) {
+            configEntries[key] = trim(line.substr(equalPos + 1));
+        }
+    }
+}
+
+
+// Function to get a configuration value as a string
+std::string configValue(const std::string& key, const std::string& defaultValue) {
+    auto it = configEntries.find(key);
+    return (it != configEntries.end()) ? it->second : defaultValue;
+}
+
+
+// Function to get a configuration value as a boolean (yes/true/on/1)
+bool configFlag(const std::string& key, bool defaultValue) {
+    auto it = configEntries.find(key);
+    if (it == configEntries.end()) {
+        return defaultValue;
+    }
+
+    std::string value = it->second;
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+    return value == "yes" || value == "true" || value == "on" || value == "1";
+}
+
+
+// Function to get a configuration value as a number
+long configNumber(const std::string& key, long defaultValue) {
+    auto it = configEntries.find(key);
+    if (it == configEntries.end()) {
+        return defaultValue;
+    }
+
+    try {
+        return std::stol(it->second);
+    } catch (const std::exception&) {
+        return defaultValue;
+    }
+}
+
+
+// Function to list the CPUs this process may run on (taskset and cpusets are honoured)
+const std::vector<int>& allowedCpus() {
+    static const std::vector<int> cpus = [] {
+        std::vector<int> result;
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &cpuSet)) {
+                    result.push_back(cpu);
+                }
+            }
+        }
+        // Fallback is 2 cores
+        if (result.empty()) {
+            unsigned int count = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 2;
+            for (unsigned int cpu = 0; cpu < count; ++cpu) {
+                result.push_back(static_cast<int>(cpu));
+            }
+        }
+        return result;
+    }();
+    return cpus;
+}
+
+
+// Function to get the NUMA node of each CPU in allowedCpus(), 0 where the kernel reports none
+const std::vector<int>& allowedCpuNodes() {
+    static const std::vector<int> nodes = [] {
+        std::vector<int> result;
+        for (int cpu : allowedCpus()) {
+            int node = 0;
+            std::string cpuDir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+            if (DIR* dir = opendir(cpuDir.c_str())) {
+                while (struct dirent* entry = readdir(dir)) {
+                    if (std::strncmp(entry->d_name, "node", 4) == 0 && std::isdigit(static_cast<unsigned char>(entry->d_name[4]))) {
+                        node = std::atoi(entry->d_name + 4);
+                        break;
+                    }
+                }
+                closedir(dir);
+            }
+            result.push_back(node);
+        }
+        return result;
+    }();
+    return nodes;
+}
+
+
+// Function to read the CPU quota of our cgroup and its ancestors in CPUs, 0 when unlimited
+static double cgroupCpuLimit() {
+    double limit = 0.0;
+    auto applyLimit = [&limit](double quota, double period) {
+        if (quota > 0 && period > 0) {
+            limit = (limit > 0.0) ? std::min(limit, quota / period) : quota / period;
+        }
+    };
+
+    std::ifstream cgroupFile("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroupFile, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            // cgroup v2, every ancestor's cpu.max caps us as well
+            std::string relative = line.substr(3);
+            while (true) {
+                std::ifstream maxFile("/sys/fs/cgroup" + relative + "/cpu.max");
+                std::string quota;
+                double period = 0;
+                if (maxFile >> quota >> period && quota != "max") {
+                    applyLimit(std::atof(quota.c_str()), period);
+                }
+                if (relative.empty() || relative == "/") {
+                    break;
+                }
+                relative = relative.substr(0, relative.rfind('/'));
+            }
+        }
+    }
+
+    // cgroup v1, as seen from inside a container
+    std::ifstream quotaFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream periodFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    double quota = 0;
+    double period = 0;
+    if (quotaFile >> quota && periodFile >> period) {
+        applyLimit(quota, period);
+    }
+    return limit;
+}
+
+
+// Function to get the number of CPUs we can actually use
+unsigned int availableCpuCount() {
+    unsigned int count = static_cast<unsigned int>(allowedCpus().size());
+    double limit = cgroupCpuLimit();
+    if (limit > 0.0) {
+        count = std::min(count, std::max(1u, static_cast<unsigned int>(std::ceil(limit))));
+    }
+    return count;
+}
+
+
 // Function to check if a string consists only of zeros
 bool isAllZeros(const std::string& str) {
     return str.find_first_not_of('0') == std::string::npos;
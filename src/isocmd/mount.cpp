@@ -7,8 +7,8 @@
 void mountAllIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::string>& mountedFiles, std::set<std::string>& skippedMessages, std::set<std::string>& mountedFails) {
     std::atomic<int> completedIsos(0);
     std::atomic<bool> isComplete(false);
-    unsigned int numThreads = std::min(static_cast<unsigned int>(isoFiles.size()), static_cast<unsigned int>(maxThreads));
-    ThreadPool pool(numThreads);
+    ConcurrencyController& mountController = concurrencyControllerFor("mount");
+    ThreadPool pool(ioPoolSize(mountController, isoFiles.size()));
     
     int totalIsos = static_cast<int>(isoFiles.size());
     
@@ -18,7 +18,8 @@ void mountAllIsoFiles(const std::vector<std::string>& isoFiles, std::set<std::st
     // Process all ISO files asynchronously
     std::vector<std::future<void>> futures;
     for (const auto& isoFile : isoFiles) {
-        futures.push_back(pool.enqueue([&isoFile, &mountedFiles, &skippedMessages, &mountedFails, &completedIsos]() {
+        futures.push_back(pool.enqueue([&isoFile, &mountedFiles, &skippedMessages, &mountedFails, &completedIsos, &mountController]() {
+            ConcurrencyController::Slot slot(mountController);
             mountIsoFile({isoFile}, mountedFiles, skippedMessages, mountedFails);
             ++completedIsos;
         }));
@@ -54,6 +55,7 @@ void select_and_mount_files_by_number() {
     // Load ISO files from cache
     std::vector<std::string> isoFiles;
 	isoFiles.reserve(100);
+	CatalogGeneration catalogGeneration; // Identity of the loaded list, lets filterCatalog reuse earlier search results
 
     // Main loop for selecting and mounting ISO files
     while (true) {
@@ -62,7 +64,7 @@ void select_and_mount_files_by_number() {
         removeNonExistentPathsFromCache();
 
         // Load ISO files from cache
-		loadCache(isoFiles);
+		loadCache(isoFiles, &catalogGeneration);
 		
 		// Check if the cache is empty
 		if (isoFiles.empty()) {
@@ -77,6 +79,7 @@ void select_and_mount_files_by_number() {
 		bool verboseFiltered = false;
         clearScrollBuffer();
         std::cout << "\033[1;93m! IF EXPECTED ISO FILES ARE NOT ON THE LIST IMPORT THEM FROM THE MAIN MENU OPTIONS !\033[0;1m\n";
+        printBackgroundRefreshStatus(false);
         
         std::string searchQuery;
         std::vector<std::string> filteredFiles;
@@ -130,12 +133,12 @@ void select_and_mount_files_by_number() {
         
 
 			if (searchQuery != nullptr) {
-				std::vector<std::string> filteredFiles = filterFiles(isoFiles, searchQuery);
+				std::vector<std::string> filteredFiles = filterCatalog(isoFiles, catalogGeneration, searchQuery);
 				free(searchQuery);
 
 				if (filteredFiles.empty()) {
 					clearScrollBuffer();
-					std::cout << "\033[1;91mNo ISO(s) match the search query.\033[0;1m\n";
+					std::cout << emptyFilterMessage("ISO(s)") << "\n";
 					std::cout << "\n\033[1;32m↵ to continue...\033[0;1m";
 					std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 				} else {
@@ -265,6 +268,18 @@ void printMountedAndErrors( std::set<std::string>& mountedFiles, std::set<std::s
 }
 
 
+// Mount points and ISO files of mount calls still running, including ones abandoned by the watchdog
+static std::mutex inFlightMountsMutex;
+static std::multiset<std::string> inFlightMounts;
+
+
+// Function to check whether a mount point or ISO file still has a watched mount in flight
+bool isMountInFlight(const std::string& path) {
+    std::lock_guard<std::mutex> lock(inFlightMountsMutex);
+    return inFlightMounts.count(path) != 0;
+}
+
+
 // Function to mount selected ISO files called from processAndMountIsoFiles
 bool isAlreadyMounted(const std::string& mountPoint) {
     struct statvfs vfs;
@@ -310,17 +325,17 @@ void mountIsoFile(const std::vector<std::string>& isoFilesToMount, std::set<std:
     size_t hashValue = hasher(isoFile);
     
     // Convert hash to a base36 string (using digits 0-9 and letters a-z)
-    const std::string base36Chars = "0123456789abcdefghijklmnopqrstuvwxyz";
-    std::string shortHash;
+    static constexpr char base36Chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char shortHash[5];
     for (int i = 0; i < 5; ++i) {  // Use 5 characters for the short hash
-        shortHash += base36Chars[hashValue % 36];
+        shortHash[i] = base36Chars[hashValue % 36];
         hashValue /= 36;
     }
     
-    // Create a unique identifier using the filename and the short hash
-    std::string uniqueId = isoFileName + "_" + shortHash;
-    
-    std::string mountPoint = "/mnt/iso_" + uniqueId;
+    // Create a unique identifier using the filename and the short hash, built in place
+    std::string mountPoint;
+    mountPoint.reserve(9 + isoFileName.size() + 1 + sizeof(shortHash));
+    mountPoint.append("/mnt/iso_").append(isoFileName).append("_").append(shortHash, sizeof(shortHash));
 
         auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(isoFile);
         auto [mountisoDirectory, mountisoFilename] = extractDirectoryAndFilename(mountPoint);
@@ -328,25 +343,23 @@ void mountIsoFile(const std::vector<std::string>& isoFilesToMount, std::set<std:
         
         // Check if mount point is already mounted
         if (isAlreadyMounted(mountPoint)) {
-            std::stringstream skippedMessage;
-            skippedMessage << "\033[1;93mISO: \033[1;92m'" << isoDirectory << "/" << isoFilename 
-                           << "'\033[1;93m already M@: \033[1;94m'" << mountisoDirectory 
-                           << "/" << mountisoFilename << "'\033[1;93m.\033[0m";
+            std::string skippedMessage = "\033[1;93mISO: \033[1;92m'" + isoDirectory + "/" + isoFilename
+                                         + "'\033[1;93m already M@: \033[1;94m'" + mountisoDirectory
+                                         + "/" + mountisoFilename + "'\033[1;93m.\033[0m";
             {
                 std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                skippedMessages.insert(skippedMessage.str());
+                skippedMessages.insert(std::move(skippedMessage));
             }
             continue;
         }
         
         // Check for root privileges
         if (geteuid() != 0) {
-            std::stringstream errorMessage;
-            errorMessage << "\033[1;91mFailed to mount: \033[1;93m'" << isoDirectory << "/" << isoFilename 
-                         << "'\033[0m\033[1;91m. Root privileges are required.\033[0m";
+            std::string errorMessage = "\033[1;91mFailed to mount: \033[1;93m'" + isoDirectory + "/" + isoFilename
+                                       + "'\033[0m\033[1;91m. Root privileges are required.\033[0m";
             {
                 std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                mountedFails.insert(errorMessage.str());
+                mountedFails.insert(std::move(errorMessage));
             }
             continue;
         }
@@ -356,18 +369,18 @@ void mountIsoFile(const std::vector<std::string>& isoFilesToMount, std::set<std:
             try {
                 fs::create_directory(mountPoint);
             } catch (const fs::filesystem_error& e) {
-                std::stringstream errorMessage;
-                errorMessage << "\033[1;91mFailed to create mount point: \033[1;93m'" << mountPoint 
-                             << "'\033[0m\033[1;91m. Error: " << e.what() << "\033[0m";
+                std::string errorMessage = "\033[1;91mFailed to create mount point: \033[1;93m'" + mountPoint
+                                           + "'\033[0m\033[1;91m. Error: " + e.what() + "\033[0m";
                 {
                     std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                    mountedFails.insert(errorMessage.str());
+                    mountedFails.insert(std::move(errorMessage));
                 }
                 continue;
             }
         }
         
         bool mountSuccess = false;
+        bool mountTimedOut = false;
         
         for (const auto& fsType : fsTypes) {
             // Attempt to load the corresponding kernel module if it exists
@@ -381,12 +394,11 @@ void mountIsoFile(const std::vector<std::string>& isoFilesToMount, std::set<std:
             // Initialize libmount context
             struct libmnt_context* cxt = mnt_new_context();
             if (!cxt) {
-                std::stringstream errorMessage;
-                errorMessage << "\033[1;91mFailed to initialize mount context for: \033[1;93m'" 
-                             << isoDirectory << "/" << isoFilename << "'\033[0m\033[1;91m.\033[0m";
+                std::string errorMessage = "\033[1;91mFailed to initialize mount context for: \033[1;93m'"
+                                           + isoDirectory + "/" + isoFilename + "'\033[0m\033[1;91m.\033[0m";
                 {
                     std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                    mountedFails.insert(errorMessage.str());
+                    mountedFails.insert(std::move(errorMessage));
                 }
                 break;
             }
@@ -397,8 +409,30 @@ void mountIsoFile(const std::vector<std::string>& isoFilesToMount, std::set<std:
             mnt_context_set_fstype(cxt, fsType.c_str());
             mnt_context_set_options(cxt, "loop,ro");
             
-            // Attempt to mount
-            int ret = mnt_context_mount(cxt);
+            // Attempt to mount under the watchdog, the context is freed by the mounting thread since a hung mount outlives this call
+            auto mountResult = std::make_shared<int>(-1);
+            {
+                std::lock_guard<std::mutex> lock(inFlightMountsMutex);
+                inFlightMounts.insert(mountPoint);
+                inFlightMounts.insert(isoFile);
+            }
+            if (!runWatchedCall("mount", [cxt, mountResult, mountPoint, isoFile]() {
+                *mountResult = mnt_context_mount(cxt);
+                mnt_free_context(cxt);
+                std::lock_guard<std::mutex> lock(inFlightMountsMutex);
+                inFlightMounts.erase(inFlightMounts.find(mountPoint));
+                inFlightMounts.erase(inFlightMounts.find(isoFile));
+            })) {
+                std::string errorMessage = "\033[1;91mFailed to mount: \033[1;93m'" + isoDirectory + "/" + isoFilename
+                                           + "'\033[0m\033[1;91m. Timed out after " + std::to_string(watchdogTimeoutSeconds("mount")) + "s, the mount was abandoned.\033[0m";
+                {
+                    std::lock_guard<std::mutex> lowLock(Mutex4Low);
+                    mountedFails.insert(std::move(errorMessage));
+                }
+                mountTimedOut = true;
+                break;
+            }
+            int ret = *mountResult;
             
             // Check if mount was successful
             if (ret == 0) {
@@ -408,26 +442,22 @@ void mountIsoFile(const std::vector<std::string>& isoFilesToMount, std::set<std:
                                               + "'\033[0;1m. {" + fsType + "}\033[0m";
                 {
                     std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                    mountedFiles.insert(mountedFileInfo);
+                    mountedFiles.insert(std::move(mountedFileInfo));
                 }
                 mountSuccess = true;
-                mnt_free_context(cxt);
                 break;
             }
-            
-            // Free the context
-            mnt_free_context(cxt);
         }
         
-        if (!mountSuccess) {
+        // A timed out mount may still complete, its mount point is left in place
+        if (!mountSuccess && !mountTimedOut) {
             // Mount failure after trying all filesystem types
-            std::stringstream errorMessage;
-            errorMessage << "\033[1;91mFailed to mount: \033[1;93m'" << isoDirectory << "/" << isoFilename 
-                         << "'.\033[0;1m {badFS}";
+            std::string errorMessage = "\033[1;91mFailed to mount: \033[1;93m'" + isoDirectory + "/" + isoFilename
+                                       + "'.\033[0;1m {badFS}";
             fs::remove(mountPoint);
             {
                 std::lock_guard<std::mutex> lowLock(Mutex4Low);
-                mountedFails.insert(errorMessage.str());
+                mountedFails.insert(std::move(errorMessage));
             }
         }
     }
@@ -441,8 +471,9 @@ void processAndMountIsoFiles(const std::string& input, const std::vector<std::st
     
     std::set<std::string> tokens;
     std::string tokenCount;
+    const size_t poolLimit = ioPoolSize(concurrencyControllerFor("mount"), isoFiles.size());
     
-    while (issCount >> tokenCount && tokens.size() < maxThreads) {
+    while (issCount >> tokenCount && tokens.size() < poolLimit) {
     if (tokenCount[0] == '-') continue;
     
     // Count the number of hyphens
@@ -466,7 +497,7 @@ void processAndMountIsoFiles(const std::string& input, const std::vector<std::st
                     if (i != 0) {
                         tokens.insert(std::to_string(i));
                     }
-                    if (tokens.size() >= maxThreads) {
+                    if (tokens.size() >= poolLimit) {
                         break;
                     }
                 }
@@ -476,14 +507,14 @@ void processAndMountIsoFiles(const std::string& input, const std::vector<std::st
 			int num = std::stoi(tokenCount);
 			if (num > 0 && static_cast<std::vector<std::string>::size_type>(num) <= isoFiles.size()) {
 				tokens.insert(tokenCount);
-				if (tokens.size() >= maxThreads) {
+				if (tokens.size() >= poolLimit) {
 					break;
 				}
 			}
 		}
 	}
     
-    unsigned int numThreads = std::min(static_cast<int>(tokens.size()), static_cast<int>(maxThreads));
+    unsigned int numThreads = std::min(static_cast<int>(tokens.size()), static_cast<int>(poolLimit));
 
     std::atomic<bool> invalidInput(false);
     std::mutex indicesMutex;
@@ -515,6 +546,7 @@ void processAndMountIsoFiles(const std::string& input, const std::vector<std::st
 
         if (shouldProcess) {
             std::vector<std::string> isoFilesToMount = {isoFiles[index - 1]};
+            ConcurrencyController::Slot slot(concurrencyControllerFor("mount"));
             mountIsoFile(isoFilesToMount, mountedFiles, skippedMessages, mountedFails);
         }
 
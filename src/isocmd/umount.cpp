@@ -1,5 +1,7 @@
 #include "../headers.h"
 #include "../threadpool.h"
+#include <linux/loop.h>
+#include <sys/ioctl.h>
 
 
 // UMOUNT STUFF
@@ -78,6 +80,118 @@ bool isDirectoryEmpty(const std::string& path) {
 }
 
 
+// Function to read the first line of a sysfs attribute
+static std::string readSysfsLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+
+// Function to detach auto-clear loop devices left attached to unmounted ISOs and remove empty /mnt/iso_* directories
+void reclaimOrphanedLoopDevices(std::set<std::string>& reclaimedMessages) {
+    if (geteuid() != 0) {
+        return;
+    }
+
+    // One pass over the mount table: mounted sources and mount points
+    std::unordered_set<std::string> mountedSources;
+    std::unordered_set<std::string> mountedTargets;
+    FILE* mountTable = setmntent("/proc/self/mounts", "r");
+    if (mountTable == nullptr) {
+        return;
+    }
+    struct mntent* mountEntry;
+    while ((mountEntry = getmntent(mountTable)) != nullptr) {
+        mountedSources.insert(mountEntry->mnt_fsname);
+        mountedTargets.insert(mountEntry->mnt_dir);
+    }
+    endmntent(mountTable);
+
+    // Loop devices whose backing ISO is no longer mounted anywhere
+    DIR* blockDir = opendir("/sys/block");
+    if (blockDir != nullptr) {
+        struct dirent* entry;
+        while ((entry = readdir(blockDir)) != nullptr) {
+            if (strncmp(entry->d_name, "loop", 4) != 0) {
+                continue;
+            }
+            const std::string sysPath = std::string("/sys/block/") + entry->d_name;
+
+            // Detached loops have no backing_file
+            std::string backingFile = readSysfsLine(sysPath + "/loop/backing_file");
+            if (backingFile.empty()) {
+                continue;
+            }
+            const std::string deletedSuffix = " (deleted)";
+            if (backingFile.size() > deletedSuffix.size() && backingFile.compare(backingFile.size() - deletedSuffix.size(), deletedSuffix.size(), deletedSuffix) == 0) {
+                backingFile.resize(backingFile.size() - deletedSuffix.size());
+            }
+            if (backingFile.size() <= 4 || !iequals(std::string_view(backingFile).substr(backingFile.size() - 4), ".iso")) {
+                continue;
+            }
+
+            // Only loops set up by mount -o loop carry autoclear, losetup devices belong to someone else
+            if (readSysfsLine(sysPath + "/loop/autoclear") != "1" || isMountInFlight(backingFile)) {
+                continue;
+            }
+
+            // Skip devices that are mounted, or held by device-mapper or partitions
+            const std::string device = std::string("/dev/") + entry->d_name;
+            bool inUse = false;
+            for (const auto& source : mountedSources) {
+                if (source.compare(0, device.size(), device) == 0 && (source.size() == device.size() || source[device.size()] == 'p')) {
+                    inUse = true;
+                    break;
+                }
+            }
+            if (!inUse && !isDirectoryEmpty(sysPath + "/holders")) {
+                inUse = true;
+            }
+            if (inUse) {
+                continue;
+            }
+
+            // O_EXCL fails while a filesystem (e.g. a lazily detached mount) still holds the device
+            // Other openers only get the device marked to detach on their last close
+            int loopFd = open(device.c_str(), O_RDONLY | O_EXCL | O_CLOEXEC);
+            if (loopFd == -1) {
+                continue;
+            }
+            if (ioctl(loopFd, LOOP_CLR_FD, 0) == 0) {
+                auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(backingFile);
+                reclaimedMessages.insert("\033[1mReclaimed loop device: \033[1;92m'" + device + "'\033[0;1m of \033[1;93m'" + isoDirectory + "/" + isoFilename + "'\033[0;1m.");
+            }
+            close(loopFd);
+        }
+        closedir(blockDir);
+    }
+
+    // Empty mount point directories of ISOs that are no longer mounted, rmdir refuses anything non-empty
+    int mntFd = open("/mnt", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (mntFd == -1) {
+        return;
+    }
+    DIR* mntDir = fdopendir(dup(mntFd));
+    if (mntDir != nullptr) {
+        struct dirent* entry;
+        while ((entry = readdir(mntDir)) != nullptr) {
+            if (entry->d_type != DT_DIR || strncmp(entry->d_name, "iso_", 4) != 0) {
+                continue;
+            }
+            const std::string mountPoint = std::string("/mnt/") + entry->d_name;
+            // A timed out mount may still complete onto its mount point
+            if (mountedTargets.count(mountPoint) == 0 && !isMountInFlight(mountPoint) && unlinkat(mntFd, entry->d_name, AT_REMOVEDIR) == 0) {
+                reclaimedMessages.insert("\033[1mRemoved stale mount point: \033[1;92m'" + mountPoint + "'\033[0;1m.");
+            }
+        }
+        closedir(mntDir);
+    }
+    close(mntFd);
+}
+
+
 // Function to unmount ISO files asynchronously
 void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>& unmountedFiles, std::set<std::string>& unmountedErrors) {
     // Check for root privileges
@@ -96,14 +210,20 @@ void unmountISO(const std::vector<std::string>& isoDirs, std::set<std::string>&
     }
 
     // Construct the unmount command
-    std::string unmountCommand = "umount -l";
-    for (const auto& isoDir : isoDirs) {
-        unmountCommand += " " + shell_escape(isoDir) + " 2>/dev/null";
-    }
+    std::vector<std::string> unmountArguments = {"umount", "-l"};
+    unmountArguments.insert(unmountArguments.end(), isoDirs.begin(), isoDirs.end());
 
-    // Execute the unmount command
-    int unmountResult = system(unmountCommand.c_str());
-    if (unmountResult != 0) {
+    // Execute the unmount command under the watchdog
+    bool timedOut = false;
+    int unmountResult = runWatchedProcess("umount", unmountArguments, timedOut);
+    if (timedOut) {
+        for (const auto& isoDir : isoDirs) {
+            auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(isoDir);
+            std::string errorMessage = "\033[1;91mFailed to unmount: \033[1;93m'" + isoDirectory + "/" + isoFilename + "'\033[1;91m. Timed out after " + std::to_string(watchdogTimeoutSeconds("umount")) + "s.\033[0m";
+            std::lock_guard<std::mutex> lowLock(Mutex4Low);
+            unmountedErrors.insert(std::move(errorMessage));
+        }
+    } else if (unmountResult != 0) {
         // Some error occurred during unmounting
         for (const auto& isoDir : isoDirs) {
             auto [isoDirectory, isoFilename] = extractDirectoryAndFilename(isoDir);
@@ -292,10 +412,21 @@ void unmountISOs() {
 				std::string token;
 				while (std::getline(ss, token, ';')) {
 					filterPatterns.push_back(token);
-					std::transform(filterPatterns.back().begin(), filterPatterns.back().end(), filterPatterns.back().begin(), ::tolower);
 				}
 				free(filterPattern);
 
+				// Compile the tokens once, the filter tasks share the result
+				std::string filterError;
+				std::shared_ptr<const FilterQuery> filterQuery = compileFilterQuery(filterPatterns, filterError);
+				if (!filterQuery) {
+					clearScrollBuffer();
+					std::cout << filterError << "\n";
+					std::cout << "\n\033[1;32m↵ to continue...";
+					std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+					clearScrollBuffer();
+					continue;
+				}
+
 				// Filter the list of ISO directories based on the filter pattern
 				filteredIsoDirs.clear();
 
@@ -314,7 +445,7 @@ void unmountISOs() {
 					size_t end = start + baseDirsPerThread + (i < remainder ? 1 : 0);
 
 					futures.push_back(std::async(std::launch::async, [&](size_t start, size_t end) {
-						filterMountPoints(isoDirs, filterPatterns, filteredIsoDirs, start, end);
+						filterMountPoints(isoDirs, *filterQuery, filteredIsoDirs, start, end);
 					}, start, end));
 				}
 
@@ -493,11 +624,12 @@ void unmountISOs() {
         // If there are selected ISOs, proceed to unmount them
         if (!selectedIsoDirs.empty()) {
 			std::vector<std::future<void>> futures;
-			unsigned int numThreads = std::min(static_cast<int>(selectedIsoDirs.size()), static_cast<int>(maxThreads));
+			ConcurrencyController& umountController = concurrencyControllerFor("umount");
+			unsigned int numThreads = static_cast<unsigned int>(ioPoolSize(umountController, selectedIsoDirs.size()));
 			ThreadPool pool(numThreads);
     
 			// Divide the selected ISOs into batches for parallel processing
-			size_t batchSize = (selectedIsoDirs.size() + maxThreads - 1) / maxThreads;
+			size_t batchSize = (selectedIsoDirs.size() + numThreads - 1) / numThreads;
 			std::vector<std::vector<std::string>> batches;
 			for (size_t i = 0; i < selectedIsoDirs.size(); i += batchSize) {
 				batches.emplace_back(selectedIsoDirs.begin() + i, std::min(selectedIsoDirs.begin() + i + batchSize, selectedIsoDirs.end()));
@@ -512,8 +644,9 @@ void unmountISOs() {
 
 			// Enqueue unmount tasks for each batch of ISOs
 			for (const auto& batch : batches) {
-				futures.emplace_back(pool.enqueue([batch, &unmountedFiles, &unmountedErrors, &completedIsos]() {
+				futures.emplace_back(pool.enqueue([batch, &unmountedFiles, &unmountedErrors, &completedIsos, &umountController]() {
 					for (const auto& iso : batch) {
+						ConcurrencyController::Slot slot(umountController);
 						unmountISO({iso}, unmountedFiles, unmountedErrors);
 						completedIsos.fetch_add(1, std::memory_order_relaxed);
 					}
@@ -528,8 +661,21 @@ void unmountISOs() {
 			// Signal completion and wait for progress thread to finish
 			isComplete.store(true);
 			progressThread.join();
+
+			// Lazy detaches and earlier crashes leave loop devices and mount points behind, reclaim them after each batch
+			std::set<std::string> reclaimedMessages;
+			reclaimOrphanedLoopDevices(reclaimedMessages);
+
             if (verbose) {
 				printUnmountedAndErrors(invalidInput, unmountedFiles, unmountedErrors, errorMessages);
+
+				// Reclaimed leftovers are listed apart from the ISOs the user unmounted
+				if (!reclaimedMessages.empty()) {
+					std::cout << "\n";
+					for (const auto& reclaimedMessage : reclaimedMessages) {
+						std::cout << "\n" << reclaimedMessage;
+					}
+				}
 			} else {
 				unmountedFiles.clear();
 				unmountedErrors.clear();
@@ -0,0 +1,273 @@
+#include "../headers.h"
+#include <map>
+#include <sys/wait.h>
+
+
+// WATCHDOG STUFF
+
+// Seconds a terminated child gets to exit before its process group is killed
+const int WATCHDOG_KILL_GRACE_SECONDS = 2;
+
+// State shared between a watched call and the detached thread running it
+struct WatchedCallState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool finished = false;
+    bool timedOut = false;
+};
+
+// In-flight operation tracked by the watchdog
+struct WatchedOperation {
+    std::string operationClass;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point deadline;
+    pid_t processGroup = 0;                     // Child process group, 0 for calls running on a detached thread
+    bool terminated = false;                    // SIGTERM was sent, SIGKILL follows after the grace period
+    std::shared_ptr<WatchedCallState> call;
+};
+
+// Single watchdog thread that enforces the deadlines of every registered operation
+class Watchdog {
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<uint64_t, WatchedOperation> operations;
+    uint64_t nextId;
+    bool stop;
+    std::thread worker;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop) {
+            auto now = std::chrono::steady_clock::now();
+            auto nextDeadline = std::chrono::steady_clock::time_point::max();
+
+            for (auto it = operations.begin(); it != operations.end();) {
+                WatchedOperation& operation = it->second;
+                if (now < operation.deadline) {
+                    nextDeadline = std::min(nextDeadline, operation.deadline);
+                    ++it;
+                    continue;
+                }
+
+                if (operation.call) {
+                    // A stuck kernel call cannot be interrupted, release its waiter and leave the thread behind
+                    {
+                        std::lock_guard<std::mutex> callLock(operation.call->mutex);
+                        operation.call->timedOut = true;
+                    }
+                    operation.call->cv.notify_all();
+                    it = operations.erase(it);
+                    continue;
+                }
+
+                // Ask the child process group to stop first, then kill it; the waiter reaps the child
+                if (!operation.terminated) {
+                    kill(-operation.processGroup, SIGTERM);
+                    operation.terminated = true;
+                    operation.deadline = now + std::chrono::seconds(WATCHDOG_KILL_GRACE_SECONDS);
+                    nextDeadline = std::min(nextDeadline, operation.deadline);
+                } else {
+                    kill(-operation.processGroup, SIGKILL);
+                    operation.deadline = std::chrono::steady_clock::time_point::max();
+                }
+                ++it;
+            }
+
+            if (nextDeadline == std::chrono::steady_clock::time_point::max()) {
+                cv.wait(lock);
+            } else {
+                cv.wait_until(lock, nextDeadline);
+            }
+        }
+    }
+
+public:
+    Watchdog() : nextId(1), stop(false), worker(&Watchdog::run, this) {}
+
+    ~Watchdog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    uint64_t track(WatchedOperation operation) {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = nextId++;
+            operations.emplace(id, std::move(operation));
+        }
+        cv.notify_all();
+        return id;
+    }
+
+    // Returns true if the operation was still tracked, i.e. it finished before the watchdog acted on it
+    bool untrack(uint64_t id, bool& terminated) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = operations.find(id);
+        if (it == operations.end()) {
+            return false;
+        }
+        terminated = it->second.terminated;
+        operations.erase(it);
+        return true;
+    }
+
+    // Kill every watched child process group, used on exit; skipped if the registry is busy
+    void killProcesses() {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+        for (const auto& [id, operation] : operations) {
+            if (operation.processGroup > 0) {
+                kill(-operation.processGroup, SIGKILL);
+            }
+        }
+    }
+};
+
+
+// Set once the watchdog exists, so exit paths do not start it just to find nothing to kill
+static std::atomic<Watchdog*> watchdogInstance(nullptr);
+
+static Watchdog& watchdog() {
+    static Watchdog instance;
+    watchdogInstance.store(&instance, std::memory_order_release);
+    return instance;
+}
+
+
+// Function to get the timeout of an operation class from watchdog_<class>_seconds, 0 disables it
+long watchdogTimeoutSeconds(const std::string& operationClass) {
+    long defaultSeconds = 0;
+    if (operationClass == "mount") {
+        defaultSeconds = 60;
+    } else if (operationClass == "umount") {
+        defaultSeconds = 30;
+    } else if (operationClass == "convert") {
+        defaultSeconds = 3600;
+    } else if (operationClass == "scan") {
+        defaultSeconds = configNumber("scan_timeout_seconds", 120); // Same stall deadline as the import walks
+    }
+    return std::max(0L, configNumber("watchdog_" + operationClass + "_seconds", defaultSeconds));
+}
+
+
+// Function to build the deadline of an operation starting now
+static std::chrono::steady_clock::time_point watchdogDeadline(std::chrono::steady_clock::time_point start, long timeoutSeconds) {
+    return timeoutSeconds > 0 ? start + std::chrono::seconds(timeoutSeconds) : std::chrono::steady_clock::time_point::max();
+}
+
+
+// Function to run a program in its own process group under the watchdog, returns its exit status or -1
+int runWatchedProcess(const std::string& operationClass, const std::vector<std::string>& arguments, bool& timedOut) {
+    timedOut = false;
+    if (arguments.empty()) {
+        return -1;
+    }
+
+    // Everything the child needs is prepared before fork, the child only execs
+    std::vector<char*> argv;
+    argv.reserve(arguments.size() + 1);
+    for (const auto& argument : arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        return -1;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        int devNull = open("/dev/null", O_RDWR);
+        if (devNull != -1) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    setpgid(pid, pid); // Also set it here, so the group exists before the watchdog may signal it
+
+    const auto start = std::chrono::steady_clock::now();
+    WatchedOperation operation;
+    operation.operationClass = operationClass;
+    operation.start = start;
+    operation.deadline = watchdogDeadline(start, watchdogTimeoutSeconds(operationClass));
+    operation.processGroup = pid;
+    const uint64_t id = watchdog().track(std::move(operation));
+
+    // Wait without reaping, the group id stays reserved until the leftovers of the program are killed
+    siginfo_t info;
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == -1 && errno == EINTR) {
+    }
+
+    bool terminated = false;
+    if (!watchdog().untrack(id, terminated) || terminated) {
+        timedOut = true;
+    }
+    kill(-pid, SIGKILL);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+
+    if (timedOut || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+
+// Function to run a blocking call on a detached thread under the watchdog, returns false if it timed out and was abandoned
+// The call must own everything it uses, it may outlive the caller
+bool runWatchedCall(const std::string& operationClass, std::function<void()> call) {
+    const long timeoutSeconds = watchdogTimeoutSeconds(operationClass);
+    if (timeoutSeconds == 0) {
+        call();
+        return true;
+    }
+
+    auto state = std::make_shared<WatchedCallState>();
+    const auto start = std::chrono::steady_clock::now();
+    WatchedOperation operation;
+    operation.operationClass = operationClass;
+    operation.start = start;
+    operation.deadline = watchdogDeadline(start, timeoutSeconds);
+    operation.call = state;
+    const uint64_t id = watchdog().track(std::move(operation));
+
+    std::thread([state, call = std::move(call)]() {
+        call();
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->finished = true;
+        }
+        state->cv.notify_all();
+    }).detach();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&state] { return state->finished || state->timedOut; });
+    const bool finished = state->finished;
+    lock.unlock();
+
+    bool terminated = false;
+    watchdog().untrack(id, terminated);
+    return finished;
+}
+
+
+// Function to kill the child processes of watched operations, called before the program exits
+void killWatchedProcesses() {
+    Watchdog* instance = watchdogInstance.load(std::memory_order_acquire);
+    if (instance != nullptr) {
+        instance->killProcesses();
+    }
+}
@@ -0,0 +1,898 @@
+#ifndef LAZYDFA_H
+#define LAZYDFA_H
+#include "headers.h"
+#include <bitset>
+#include <map>
+
+
+// Regular expressions over case folded UTF-8 text, compiled once into a byte NFA and evaluated through a lazily built DFA.
+// Supported: literals, '.', [classes] with ranges and [^negation], \d \w \s \D \W \S, groups (...) and (?:...),
+// alternation '|', quantifiers * + ? {m} {m,} {m,n}, and the anchors ^ $. There are no backreferences or lookarounds.
+
+// Parsed regular expression
+struct RegexNode {
+    enum Kind { Bytes, Concat, Alternate, Repeat, Empty, BeginAnchor, EndAnchor };
+    Kind kind = Empty;
+    std::bitset<256> bytes;             // Bytes: the bytes this node consumes
+    std::vector<RegexNode> children;
+    int minCount = 0;
+    int maxCount = -1;                  // Repeat: -1 for unbounded
+};
+
+// One NFA state, Consume steps over a byte of its set, Split and the anchors are epsilon moves
+struct NfaState {
+    enum Kind : uint8_t { Consume, Split, AssertBegin, AssertEnd, Match };
+    Kind kind;
+    int byteSet = -1;
+    int next = -1;
+    int alt = -1;
+};
+
+// Compiled regular expression, shared read-only by every thread that evaluates it
+struct RegexProgram {
+    std::vector<NfaState> states;
+    std::vector<std::bitset<256>> byteSets;
+    int start = -1;
+    std::string requiredLiteral;        // Folded bytes every match contains, used as a prefilter
+};
+
+
+namespace regex_detail {
+
+const int MAX_REPEAT = 1000;
+const size_t MAX_NFA_STATES = 100000;
+const int MAX_CLASS_RANGE = 4096;
+
+inline RegexNode bytesNode(const std::bitset<256>& bytes) {
+    RegexNode node;
+    node.kind = RegexNode::Bytes;
+    node.bytes = bytes;
+    return node;
+}
+
+inline RegexNode byteRangeNode(unsigned lo, unsigned hi) {
+    std::bitset<256> bytes;
+    for (unsigned b = lo; b <= hi; ++b) {
+        bytes.set(b);
+    }
+    return bytesNode(bytes);
+}
+
+inline RegexNode concatNode(std::vector<RegexNode> children) {
+    if (children.size() == 1) {
+        return std::move(children[0]);
+    }
+    RegexNode node;
+    node.kind = children.empty() ? RegexNode::Empty : RegexNode::Concat;
+    node.children = std::move(children);
+    return node;
+}
+
+inline RegexNode alternateNode(std::vector<RegexNode> children) {
+    if (children.size() == 1) {
+        return std::move(children[0]);
+    }
+    RegexNode node;
+    node.kind = RegexNode::Alternate;
+    node.children = std::move(children);
+    return node;
+}
+
+// Sequence of single-byte nodes for already folded UTF-8 text
+inline RegexNode literalNode(std::string_view folded) {
+    std::vector<RegexNode> bytes;
+    for (unsigned char c : folded) {
+        std::bitset<256> set;
+        set.set(c);
+        bytes.push_back(bytesNode(set));
+    }
+    return concatNode(std::move(bytes));
+}
+
+// Any multi-byte UTF-8 code point
+inline std::vector<RegexNode> multiByteCodePoint() {
+    std::vector<RegexNode> alternatives;
+    alternatives.push_back(concatNode({byteRangeNode(0xC2, 0xDF), byteRangeNode(0x80, 0xBF)}));
+    alternatives.push_back(concatNode({byteRangeNode(0xE0, 0xEF), byteRangeNode(0x80, 0xBF), byteRangeNode(0x80, 0xBF)}));
+    alternatives.push_back(concatNode({byteRangeNode(0xF0, 0xF4), byteRangeNode(0x80, 0xBF), byteRangeNode(0x80, 0xBF), byteRangeNode(0x80, 0xBF)}));
+    return alternatives;
+}
+
+// Code point class: ASCII members as a byte set, other members as folded UTF-8 sequences
+struct ClassSet {
+    std::bitset<256> ascii;
+    std::set<std::string> sequences;
+    bool anyMultiByte = false;
+};
+
+inline size_t utf8Length(unsigned char lead) {
+    if (lead < 0x80) return 1;
+    if ((lead & 0xE0) == 0xC0) return 2;
+    if ((lead & 0xF0) == 0xE0) return 3;
+    if ((lead & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+inline uint32_t decodeCodePoint(std::string_view bytes) {
+    const unsigned char lead = bytes[0];
+    const size_t length = bytes.size();
+    uint32_t codePoint = length == 1 ? lead : length == 2 ? (lead & 0x1F) : length == 3 ? (lead & 0x0F) : (lead & 0x07);
+    for (size_t i = 1; i < length; ++i) {
+        codePoint = (codePoint << 6) | (static_cast<unsigned char>(bytes[i]) & 0x3F);
+    }
+    return codePoint;
+}
+
+inline std::string encodeCodePoint(uint32_t codePoint) {
+    std::string out;
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    return out;
+}
+
+// Add one code point to a class in its folded form
+inline void addToClass(ClassSet& set, const std::string& codePoint) {
+    std::string folded = foldCase(codePoint);
+    if (folded.size() == 1 && static_cast<unsigned char>(folded[0]) < 0x80) {
+        set.ascii.set(static_cast<unsigned char>(folded[0]));
+    } else {
+        set.sequences.insert(std::move(folded));
+    }
+}
+
+// Byte sets of the \d \w \s shorthands, as they appear in folded text
+inline std::bitset<256> shorthandSet(char letter) {
+    std::bitset<256> set;
+    switch (std::tolower(static_cast<unsigned char>(letter))) {
+        case 'd':
+            for (int c = '0'; c <= '9'; ++c) set.set(c);
+            break;
+        case 'w':
+            for (int c = '0'; c <= '9'; ++c) set.set(c);
+            for (int c = 'a'; c <= 'z'; ++c) set.set(c);
+            set.set('_');
+            break;
+        default:
+            for (char c : std::string(" \t\n\r\f\v")) set.set(static_cast<unsigned char>(c));
+            break;
+    }
+    return set;
+}
+
+inline std::bitset<256> asciiComplement(const std::bitset<256>& set) {
+    std::bitset<256> complement;
+    for (int c = 0; c < 0x80; ++c) {
+        if (!set[c]) complement.set(c);
+    }
+    return complement;
+}
+
+// Node for a class: the ASCII byte set or any of the sequences
+inline RegexNode classNode(const ClassSet& set) {
+    std::vector<RegexNode> alternatives;
+    if (set.ascii.any()) {
+        alternatives.push_back(bytesNode(set.ascii));
+    }
+    for (const auto& sequence : set.sequences) {
+        alternatives.push_back(literalNode(sequence));
+    }
+    if (set.anyMultiByte) {
+        for (auto& alternative : multiByteCodePoint()) {
+            alternatives.push_back(std::move(alternative));
+        }
+    }
+    if (alternatives.empty()) {
+        return bytesNode(std::bitset<256>()); // Matches nothing
+    }
+    return alternateNode(std::move(alternatives));
+}
+
+
+// Recursive descent parser, literals are case folded while parsing so escapes like \D keep their meaning
+class RegexParser {
+public:
+    explicit RegexParser(std::string_view source) : pattern(source), pos(0) {}
+
+    bool parse(RegexNode& root, std::string& error) {
+        root = parseAlternation();
+        if (errorMessage.empty() && pos < pattern.size()) {
+            errorMessage = "unmatched ')'";
+        }
+        error = errorMessage;
+        return errorMessage.empty();
+    }
+
+private:
+    std::string_view pattern;
+    size_t pos;
+    std::string errorMessage;
+
+    bool atEnd() const { return pos >= pattern.size(); }
+
+    RegexNode fail(const std::string& message) {
+        if (errorMessage.empty()) {
+            errorMessage = message;
+        }
+        pos = pattern.size();
+        return RegexNode();
+    }
+
+    // Next code point of the pattern as raw UTF-8
+    std::string takeCodePoint() {
+        size_t length = std::min(utf8Length(static_cast<unsigned char>(pattern[pos])), pattern.size() - pos);
+        std::string codePoint(pattern.substr(pos, length));
+        pos += length;
+        return codePoint;
+    }
+
+    RegexNode parseAlternation() {
+        std::vector<RegexNode> alternatives;
+        alternatives.push_back(parseConcat());
+        while (!atEnd() && pattern[pos] == '|') {
+            ++pos;
+            alternatives.push_back(parseConcat());
+        }
+        return alternateNode(std::move(alternatives));
+    }
+
+    RegexNode parseConcat() {
+        std::vector<RegexNode> items;
+        while (!atEnd() && pattern[pos] != '|' && pattern[pos] != ')') {
+            items.push_back(parseRepeat());
+        }
+        return concatNode(std::move(items));
+    }
+
+    bool parseNumber(int& value) {
+        size_t begin = pos;
+        value = 0;
+        while (!atEnd() && std::isdigit(static_cast<unsigned char>(pattern[pos]))) {
+            value = std::min(value * 10 + (pattern[pos] - '0'), MAX_REPEAT + 1);
+            ++pos;
+        }
+        return pos > begin;
+    }
+
+    RegexNode parseRepeat() {
+        RegexNode atom = parseAtom();
+        while (!atEnd()) {
+            int minCount, maxCount;
+            char c = pattern[pos];
+            if (c == '*') {
+                minCount = 0; maxCount = -1; ++pos;
+            } else if (c == '+') {
+                minCount = 1; maxCount = -1; ++pos;
+            } else if (c == '?') {
+                minCount = 0; maxCount = 1; ++pos;
+            } else if (c == '{') {
+                size_t brace = pos++;
+                if (!parseNumber(minCount)) {
+                    pos = brace;
+                    break; // Not a quantifier, '{' is taken literally by the next atom
+                }
+                maxCount = minCount;
+                if (!atEnd() && pattern[pos] == ',') {
+                    ++pos;
+                    if (!parseNumber(maxCount)) {
+                        maxCount = -1;
+                    }
+                }
+                if (atEnd() || pattern[pos] != '}') {
+                    return fail("unterminated {m,n} quantifier");
+                }
+                ++pos;
+                if (minCount > MAX_REPEAT || maxCount > MAX_REPEAT || (maxCount >= 0 && maxCount < minCount)) {
+                    return fail("invalid {m,n} quantifier");
+                }
+            } else {
+                break;
+            }
+            // Lazy and possessive markers do not change whether a path matches
+            if (!atEnd() && (pattern[pos] == '?' || pattern[pos] == '+')) {
+                ++pos;
+            }
+            RegexNode repeat;
+            repeat.kind = RegexNode::Repeat;
+            repeat.minCount = minCount;
+            repeat.maxCount = maxCount;
+            repeat.children.push_back(std::move(atom));
+            atom = std::move(repeat);
+        }
+        return atom;
+    }
+
+    RegexNode parseAtom() {
+        char c = pattern[pos];
+        switch (c) {
+            case '(': {
+                ++pos;
+                if (pattern.substr(pos, 2) == "?:") {
+                    pos += 2;
+                } else if (!atEnd() && pattern[pos] == '?') {
+                    return fail("unsupported group type '(?'");
+                }
+                RegexNode inner = parseAlternation();
+                if (atEnd() || pattern[pos] != ')') {
+                    return fail("missing ')'");
+                }
+                ++pos;
+                return inner;
+            }
+            case '[':
+                ++pos;
+                return parseClass();
+            case '.': {
+                ++pos;
+                ClassSet any;
+                any.ascii = asciiComplement(std::bitset<256>());
+                any.anyMultiByte = true;
+                return classNode(any);
+            }
+            case '^': {
+                ++pos;
+                RegexNode node;
+                node.kind = RegexNode::BeginAnchor;
+                return node;
+            }
+            case '$': {
+                ++pos;
+                RegexNode node;
+                node.kind = RegexNode::EndAnchor;
+                return node;
+            }
+            case '*':
+            case '+':
+            case '?':
+                return fail(std::string("nothing to repeat before '") + c + "'");
+            case '\\':
+                return parseEscape();
+            default:
+                return literalNode(foldCase(takeCodePoint()));
+        }
+    }
+
+    RegexNode parseEscape() {
+        ++pos;
+        if (atEnd()) {
+            return fail("trailing '\\'");
+        }
+        char c = pattern[pos];
+        if (std::strchr("dwsDWS", c) != nullptr) {
+            ++pos;
+            ClassSet set;
+            set.ascii = shorthandSet(c);
+            if (std::isupper(static_cast<unsigned char>(c))) {
+                set.ascii = asciiComplement(set.ascii);
+                set.anyMultiByte = true;
+            }
+            return classNode(set);
+        }
+        if (c == 't' || c == 'n') {
+            ++pos;
+            return literalNode(c == 't' ? "\t" : "\n");
+        }
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            return fail(std::string("unsupported escape '\\") + c + "'");
+        }
+        return literalNode(foldCase(takeCodePoint()));
+    }
+
+    // One class member: a code point, possibly escaped, or a shorthand that is added to the set directly
+    bool parseClassMember(ClassSet& set, std::string& codePoint) {
+        if (pattern[pos] == '\\') {
+            ++pos;
+            if (atEnd()) {
+                fail("unterminated character class");
+                return false;
+            }
+            char c = pattern[pos];
+            if (std::strchr("dwsDWS", c) != nullptr) {
+                ++pos;
+                if (std::isupper(static_cast<unsigned char>(c))) {
+                    set.ascii |= asciiComplement(shorthandSet(c));
+                    set.anyMultiByte = true;
+                } else {
+                    set.ascii |= shorthandSet(c);
+                }
+                codePoint.clear();
+                return true;
+            }
+            if (c == 't' || c == 'n') {
+                ++pos;
+                codePoint = (c == 't') ? "\t" : "\n";
+                return true;
+            }
+        }
+        codePoint = takeCodePoint();
+        return true;
+    }
+
+    RegexNode parseClass() {
+        bool negated = false;
+        if (!atEnd() && pattern[pos] == '^') {
+            negated = true;
+            ++pos;
+        }
+
+        ClassSet set;
+        bool first = true;
+        while (true) {
+            if (atEnd()) {
+                return fail("unterminated character class");
+            }
+            if (pattern[pos] == ']' && !first) {
+                ++pos;
+                break;
+            }
+            first = false;
+
+            std::string low;
+            if (!parseClassMember(set, low)) {
+                return RegexNode();
+            }
+            if (low.empty()) {
+                continue; // Shorthand, already added
+            }
+
+            // Range: both ends are single code points
+            if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+                ++pos;
+                std::string high;
+                if (!parseClassMember(set, high)) {
+                    return RegexNode();
+                }
+                if (high.empty()) {
+                    return fail("invalid class range");
+                }
+                uint32_t lowCodePoint = decodeCodePoint(low);
+                uint32_t highCodePoint = decodeCodePoint(high);
+                if (highCodePoint < lowCodePoint) {
+                    return fail("invalid class range");
+                }
+                if (highCodePoint - lowCodePoint > static_cast<uint32_t>(MAX_CLASS_RANGE)) {
+                    return fail("class range too large");
+                }
+                for (uint32_t codePoint = lowCodePoint; codePoint <= highCodePoint; ++codePoint) {
+                    addToClass(set, encodeCodePoint(codePoint));
+                }
+            } else {
+                addToClass(set, low);
+            }
+        }
+
+        if (!negated) {
+            return classNode(set);
+        }
+        if (!set.sequences.empty() || set.anyMultiByte) {
+            return fail("negated classes support ASCII members only");
+        }
+        ClassSet complement;
+        complement.ascii = asciiComplement(set.ascii);
+        complement.anyMultiByte = true;
+        return classNode(complement);
+    }
+};
+
+
+// Thompson construction, fragments are patched through (state, field) pairs
+struct Fragment {
+    int start;
+    std::vector<std::pair<int, bool>> outs; // false: next, true: alt
+};
+
+class NfaCompiler {
+public:
+    explicit NfaCompiler(RegexProgram& target) : program(target) {}
+
+    bool compile(const RegexNode& root, std::string& error) {
+        Fragment fragment = emit(root);
+        if (program.states.size() > MAX_NFA_STATES) {
+            error = "pattern too large";
+            return false;
+        }
+        int match = addState(NfaState::Match);
+        patch(fragment, match);
+        program.start = fragment.start;
+        return true;
+    }
+
+private:
+    RegexProgram& program;
+
+    int addState(NfaState::Kind kind, int byteSet = -1) {
+        NfaState state;
+        state.kind = kind;
+        state.byteSet = byteSet;
+        program.states.push_back(state);
+        return static_cast<int>(program.states.size()) - 1;
+    }
+
+    void patch(const Fragment& fragment, int target) {
+        for (const auto& [state, alt] : fragment.outs) {
+            if (alt) {
+                program.states[state].alt = target;
+            } else {
+                program.states[state].next = target;
+            }
+        }
+    }
+
+    Fragment epsilon() {
+        int state = addState(NfaState::Split);
+        return {state, {{state, false}}};
+    }
+
+    Fragment emit(const RegexNode& node) {
+        // Give up early on patterns that expand beyond the state limit, e.g. nested counted repeats
+        if (program.states.size() > MAX_NFA_STATES) {
+            return epsilon();
+        }
+        switch (node.kind) {
+            case RegexNode::Bytes: {
+                program.byteSets.push_back(node.bytes);
+                int state = addState(NfaState::Consume, static_cast<int>(program.byteSets.size()) - 1);
+                return {state, {{state, false}}};
+            }
+            case RegexNode::BeginAnchor:
+            case RegexNode::EndAnchor: {
+                int state = addState(node.kind == RegexNode::BeginAnchor ? NfaState::AssertBegin : NfaState::AssertEnd);
+                return {state, {{state, false}}};
+            }
+            case RegexNode::Empty:
+                return epsilon();
+            case RegexNode::Concat: {
+                Fragment result = emit(node.children[0]);
+                for (size_t i = 1; i < node.children.size(); ++i) {
+                    Fragment next = emit(node.children[i]);
+                    patch(result, next.start);
+                    result.outs = std::move(next.outs);
+                }
+                return result;
+            }
+            case RegexNode::Alternate: {
+                Fragment result = emit(node.children.back());
+                for (size_t i = node.children.size() - 1; i-- > 0;) {
+                    Fragment branch = emit(node.children[i]);
+                    int split = addState(NfaState::Split);
+                    program.states[split].next = branch.start;
+                    program.states[split].alt = result.start;
+                    branch.outs.insert(branch.outs.end(), result.outs.begin(), result.outs.end());
+                    result = {split, std::move(branch.outs)};
+                }
+                return result;
+            }
+            case RegexNode::Repeat:
+                return emitRepeat(node.children[0], node.minCount, node.maxCount);
+        }
+        return epsilon();
+    }
+
+    Fragment emitRepeat(const RegexNode& child, int minCount, int maxCount) {
+        Fragment result = epsilon();
+        auto append = [&result, this](Fragment next) {
+            patch(result, next.start);
+            result.outs = std::move(next.outs);
+        };
+
+        for (int i = 0; i < minCount; ++i) {
+            append(emit(child));
+        }
+
+        if (maxCount < 0) {
+            // Loop: split into the child or out, the child returns to the split
+            int split = addState(NfaState::Split);
+            Fragment body = emit(child);
+            program.states[split].next = body.start;
+            patch(body, split);
+            append({split, {{split, true}}});
+            return result;
+        }
+
+        // Optional copies, each may skip everything after it
+        std::vector<std::pair<int, bool>> skips;
+        for (int i = minCount; i < maxCount; ++i) {
+            int split = addState(NfaState::Split);
+            Fragment body = emit(child);
+            program.states[split].next = body.start;
+            skips.push_back({split, true});
+            append({split, std::move(body.outs)});
+        }
+        result.outs.insert(result.outs.end(), skips.begin(), skips.end());
+        return result;
+    }
+};
+
+
+// Longest run of bytes every match must contain, collected from the mandatory parts of the pattern
+inline void collectRequiredLiteral(const RegexNode& node, std::string& run, std::string& best) {
+    auto flush = [&run, &best]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+
+    switch (node.kind) {
+        case RegexNode::Bytes:
+            if (node.bytes.count() == 1) {
+                for (int b = 0; b < 256; ++b) {
+                    if (node.bytes[b]) {
+                        run.push_back(static_cast<char>(b));
+                        break;
+                    }
+                }
+            } else {
+                flush();
+            }
+            break;
+        case RegexNode::Concat:
+            for (const auto& child : node.children) {
+                collectRequiredLiteral(child, run, best);
+            }
+            break;
+        case RegexNode::Empty:
+        case RegexNode::BeginAnchor:
+        case RegexNode::EndAnchor:
+            break;
+        case RegexNode::Repeat:
+            flush();
+            if (node.minCount >= 1) {
+                std::string inner;
+                collectRequiredLiteral(node.children[0], inner, best);
+                run = std::move(inner);
+                flush();
+            }
+            break;
+        case RegexNode::Alternate:
+            flush();
+            break;
+    }
+}
+
+} // namespace regex_detail
+
+
+// Function to compile a regular expression, returns false and a reason if the pattern is invalid
+inline bool compileRegex(std::string_view pattern, RegexProgram& program, std::string& error) {
+    RegexNode root;
+    regex_detail::RegexParser parser(pattern);
+    if (!parser.parse(root, error)) {
+        return false;
+    }
+
+    program = RegexProgram();
+    regex_detail::NfaCompiler compiler(program);
+    if (!compiler.compile(root, error)) {
+        return false;
+    }
+
+    std::string run;
+    regex_detail::collectRequiredLiteral(root, run, program.requiredLiteral);
+    if (run.size() > program.requiredLiteral.size()) {
+        program.requiredLiteral = run;
+    }
+    return true;
+}
+
+
+// Function to translate a shell glob into an anchored regular expression: * any run, ? one character, [...] and [!...] classes
+inline std::string globToRegex(std::string_view glob) {
+    std::string regex = "^(?:";
+    for (size_t i = 0; i < glob.size(); ++i) {
+        char c = glob[i];
+        if (c == '*') {
+            regex += ".*";
+        } else if (c == '?') {
+            regex += ".";
+        } else if (c == '[') {
+            size_t close = i + 1;
+            if (close < glob.size() && (glob[close] == '!' || glob[close] == '^')) ++close;
+            if (close < glob.size() && glob[close] == ']') ++close;
+            close = glob.find(']', close);
+            if (close == std::string_view::npos) {
+                regex += "\\[";
+                continue;
+            }
+            regex += '[';
+            size_t j = i + 1;
+            if (glob[j] == '!' || glob[j] == '^') {
+                regex += '^';
+                ++j;
+            }
+            for (; j < close; ++j) {
+                if (glob[j] == '\\' || glob[j] == '[') regex += '\\';
+                regex += glob[j];
+            }
+            regex += ']';
+            i = close;
+        } else if (c == '\\' && i + 1 < glob.size()) {
+            ++i;
+            if (std::isalnum(static_cast<unsigned char>(glob[i]))) {
+                regex += glob[i];
+            } else {
+                regex += '\\';
+                regex += glob[i];
+            }
+        } else if (std::strchr(".^$|()+{}\\", c) != nullptr) {
+            regex += '\\';
+            regex += c;
+        } else {
+            regex += c;
+        }
+    }
+    regex += ")$";
+    return regex;
+}
+
+
+// DFA built on demand from a RegexProgram, one per evaluating thread so no locking is needed.
+// Each DFA state is the set of NFA states alive after the bytes seen so far; the search is unanchored,
+// so the start set is re-entered at every position.
+class LazyDfa {
+private:
+    static constexpr size_t MAX_DFA_STATES = 1024; // 1 KiB of transitions each, so at most 1 MiB per DFA
+    static constexpr int UNKNOWN = -1;
+
+    const RegexProgram& program;
+    std::map<std::vector<int>, int> stateIds;
+    std::vector<std::vector<int>> stateSets;
+    std::vector<uint8_t> accepting;       // A Match state is in the set
+    std::vector<int8_t> acceptingAtEnd;   // Match is reachable through '$', computed when the text ends there
+    std::vector<int> transitions;         // stateSets.size() x 256, UNKNOWN until first taken
+    std::vector<int> laterStart;          // Start closure away from the beginning of the text
+    int beginState;
+    size_t flushes;
+
+    // Epsilon closure, '^' passes only at the beginning and '$' only when asked for at the end
+    void closure(std::vector<int>& pending, bool atBegin, bool atEnd, std::vector<int>& out, std::vector<uint8_t>& seen) const {
+        while (!pending.empty()) {
+            int id = pending.back();
+            pending.pop_back();
+            if (id < 0 || seen[id]) {
+                continue;
+            }
+            seen[id] = 1;
+            const NfaState& state = program.states[id];
+            switch (state.kind) {
+                case NfaState::Split:
+                    pending.push_back(state.alt);
+                    pending.push_back(state.next);
+                    break;
+                case NfaState::AssertBegin:
+                    if (atBegin) pending.push_back(state.next);
+                    break;
+                case NfaState::AssertEnd:
+                    out.push_back(id);
+                    if (atEnd) pending.push_back(state.next);
+                    break;
+                default:
+                    out.push_back(id);
+                    break;
+            }
+        }
+    }
+
+    std::vector<int> startSet(bool atBegin) const {
+        std::vector<int> pending{program.start};
+        std::vector<int> out;
+        std::vector<uint8_t> seen(program.states.size(), 0);
+        closure(pending, atBegin, false, out, seen);
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    int intern(std::vector<int> set) {
+        auto it = stateIds.find(set);
+        if (it != stateIds.end()) {
+            return it->second;
+        }
+
+        // Drop the cache when it grows too large, states are rebuilt as they are needed again
+        if (stateSets.size() >= MAX_DFA_STATES) {
+            stateIds.clear();
+            stateSets.clear();
+            accepting.clear();
+            acceptingAtEnd.clear();
+            transitions.clear();
+            beginState = UNKNOWN;
+            ++flushes;
+        }
+
+        int id = static_cast<int>(stateSets.size());
+        bool isAccepting = std::any_of(set.begin(), set.end(), [this](int s) { return program.states[s].kind == NfaState::Match; });
+        accepting.push_back(isAccepting ? 1 : 0);
+        acceptingAtEnd.push_back(isAccepting ? 1 : UNKNOWN);
+        transitions.resize(transitions.size() + 256, UNKNOWN);
+        stateIds.emplace(set, id);
+        stateSets.push_back(std::move(set));
+        return id;
+    }
+
+    int step(int from, unsigned char byte) {
+        std::vector<int> pending;
+        for (int id : stateSets[from]) {
+            const NfaState& state = program.states[id];
+            if (state.kind == NfaState::Consume && program.byteSets[state.byteSet][byte]) {
+                pending.push_back(state.next);
+            }
+        }
+        std::vector<int> out;
+        std::vector<uint8_t> seen(program.states.size(), 0);
+        closure(pending, false, false, out, seen);
+        out.insert(out.end(), laterStart.begin(), laterStart.end());
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+
+        const size_t generation = flushes;
+        int to = intern(std::move(out));
+        // The cache may have been dropped while interning, then the source state no longer exists
+        if (generation == flushes) {
+            transitions[static_cast<size_t>(from) * 256 + byte] = to;
+        }
+        return to;
+    }
+
+    bool acceptsAtEnd(int id, bool atBegin) {
+        if (acceptingAtEnd[id] != UNKNOWN && !atBegin) {
+            return acceptingAtEnd[id] == 1;
+        }
+        std::vector<int> pending;
+        for (int s : stateSets[id]) {
+            if (program.states[s].kind == NfaState::AssertEnd) {
+                pending.push_back(program.states[s].next);
+            }
+        }
+        std::vector<int> out;
+        std::vector<uint8_t> seen(program.states.size(), 0);
+        closure(pending, atBegin, true, out, seen);
+        bool result = std::any_of(out.begin(), out.end(), [this](int s) { return program.states[s].kind == NfaState::Match; });
+        if (!atBegin) {
+            acceptingAtEnd[id] = result ? 1 : 0;
+        }
+        return result;
+    }
+
+public:
+    explicit LazyDfa(const RegexProgram& compiled) : program(compiled), laterStart(startSet(false)), beginState(UNKNOWN), flushes(0) {}
+
+    // Whether the pattern matches anywhere in the folded text
+    bool search(std::string_view text) {
+        if (beginState == UNKNOWN) {
+            beginState = intern(startSet(true));
+        }
+        int state = beginState;
+        if (accepting[state]) {
+            return true;
+        }
+        for (size_t i = 0; i < text.size(); ++i) {
+            const unsigned char byte = static_cast<unsigned char>(text[i]);
+            int next = transitions[static_cast<size_t>(state) * 256 + byte];
+            if (next == UNKNOWN) {
+                next = step(state, byte);
+            }
+            state = next;
+            if (accepting[state]) {
+                return true;
+            }
+            if (stateSets[state].empty()) {
+                return false; // Dead: nothing alive and nothing can start again
+            }
+        }
+        return acceptsAtEnd(state, text.empty());
+    }
+};
+
+#endif // LAZYDFA_H
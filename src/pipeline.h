@@ -0,0 +1,378 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include "headers.h"
+#include <deque>
+#include <iomanip>
+
+
+// Bounded multi-producer multi-consumer ring queue, each cell carries a sequence number so push and pop never lock
+template <typename T>
+class BoundedQueue {
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct alignas(CACHE_LINE_SIZE) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos;
+
+    // Capacity is rounded up to a power of two so positions wrap with a mask
+    static size_t roundCapacity(size_t capacity) {
+        size_t rounded = 2;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        return rounded;
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity) : cells(new Cell[roundCapacity(capacity)]), mask(roundCapacity(capacity) - 1), enqueue_pos(0), dequeue_pos(0) {
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false without touching value when the queue is full
+    bool try_push(T& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (difference == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false when the queue is empty
+    bool try_pop(T& value) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (difference == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+
+// Counters of one pipeline stage, updated by its workers
+struct PipelineStageMetrics {
+    std::string name;
+    size_t workers = 0;
+    std::atomic<size_t> itemsIn{0};
+    std::atomic<size_t> itemsOut{0};
+    std::atomic<int64_t> busyNs{0};     // Time spent inside the stage function
+    std::atomic<int64_t> starvedNs{0};  // Time spent waiting for input
+    std::atomic<int64_t> blockedNs{0};  // Time spent waiting for room downstream (backpressure)
+};
+
+// Snapshot of a stage's metrics once the pipeline has finished
+struct PipelineStageReport {
+    std::string name;
+    size_t workers;
+    size_t itemsIn;
+    size_t itemsOut;
+    double busySeconds;
+    double starvedSeconds;
+    double blockedSeconds;
+};
+
+// Spin briefly, then yield, then sleep, while a queue is full or empty
+inline void pipelineBackoff(unsigned& attempt) {
+    if (attempt < 64) {
+        ++attempt;
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+inline int64_t pipelineElapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Queue between two stages, it is drained once every worker of the producing stage has finished
+template <typename T>
+class PipelineChannel {
+private:
+    BoundedQueue<T> queue;
+    std::atomic<size_t> producers;
+    const std::atomic<bool>& cancelled;
+
+public:
+    PipelineChannel(size_t capacity, size_t producerCount, const std::atomic<bool>& cancelFlag) : queue(capacity), producers(producerCount), cancelled(cancelFlag) {}
+
+    // Blocks while the queue is full, returns false if the pipeline was cancelled
+    bool push(T value, int64_t& blockedNs) {
+        if (queue.try_push(value)) {
+            return true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        unsigned attempt = 0;
+        bool pushed = true;
+        while (!queue.try_push(value)) {
+            if (cancelled.load(std::memory_order_relaxed)) {
+                pushed = false;
+                break;
+            }
+            pipelineBackoff(attempt);
+        }
+        blockedNs += pipelineElapsedNs(start);
+        return pushed;
+    }
+
+    // Blocks while the queue is empty, returns false at end of stream or on cancellation
+    bool pop(T& value, std::atomic<int64_t>& starvedNs) {
+        if (queue.try_pop(value)) {
+            return true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        unsigned attempt = 0;
+        bool received = false;
+        while (!cancelled.load(std::memory_order_relaxed)) {
+            if (queue.try_pop(value)) {
+                received = true;
+                break;
+            }
+            // Producers publish before they leave, so one more pop after seeing zero cannot miss an item
+            if (producers.load(std::memory_order_acquire) == 0) {
+                received = queue.try_pop(value);
+                break;
+            }
+            pipelineBackoff(attempt);
+        }
+        starvedNs.fetch_add(pipelineElapsedNs(start), std::memory_order_relaxed);
+        return received;
+    }
+
+    void producerFinished() {
+        producers.fetch_sub(1, std::memory_order_acq_rel);
+    }
+};
+
+// Handed to stage functions to pass items downstream
+template <typename T>
+class PipelineEmitter {
+private:
+    PipelineChannel<T>& channel;
+    PipelineStageMetrics& metrics;
+    int64_t blocked = 0; // This worker's backpressure time, so busy time excludes it
+
+public:
+    PipelineEmitter(PipelineChannel<T>& output, PipelineStageMetrics& stageMetrics) : channel(output), metrics(stageMetrics) {}
+
+    // Returns false once the pipeline is cancelled, so sources can stop producing
+    bool operator()(T value) {
+        int64_t blockedBefore = blocked;
+        bool pushed = channel.push(std::move(value), blocked);
+        metrics.blockedNs.fetch_add(blocked - blockedBefore, std::memory_order_relaxed);
+        if (pushed) {
+            metrics.itemsOut.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pushed;
+    }
+
+    const int64_t& blockedTime() const {
+        return blocked;
+    }
+};
+
+
+// Multi-stage job whose stages run concurrently on their own threads, joined by bounded queues for backpressure
+class Pipeline {
+private:
+    size_t queue_capacity;
+    std::atomic<bool> cancelled;
+    std::mutex failure_mutex;
+    std::exception_ptr failure;
+    std::deque<std::shared_ptr<void>> channels;
+    std::deque<PipelineStageMetrics> stages;
+    std::vector<std::function<void()>> workers;
+
+    PipelineStageMetrics& addStage(const std::string& name, size_t workerCount) {
+        stages.emplace_back();
+        stages.back().name = name;
+        stages.back().workers = workerCount;
+        return stages.back();
+    }
+
+    template <typename T>
+    PipelineChannel<T>& addChannel(size_t producerCount) {
+        auto channel = std::make_shared<PipelineChannel<T>>(queue_capacity, producerCount, cancelled);
+        channels.push_back(channel);
+        return *channel;
+    }
+
+    // The first exception cancels every stage, run() rethrows it after all workers have left
+    void fail() {
+        std::lock_guard<std::mutex> lock(failure_mutex);
+        if (!failure) {
+            failure = std::current_exception();
+        }
+        cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    // Busy time of one call, excluding the time it spent blocked on a full downstream queue
+    template <typename Call>
+    void timeCall(PipelineStageMetrics& metrics, const int64_t& blockedTime, Call&& call) {
+        int64_t blockedBefore = blockedTime;
+        auto start = std::chrono::steady_clock::now();
+        call();
+        int64_t blocked = blockedTime - blockedBefore;
+        metrics.busyNs.fetch_add(std::max<int64_t>(0, pipelineElapsedNs(start) - blocked), std::memory_order_relaxed);
+    }
+
+public:
+    explicit Pipeline(size_t queueCapacity = 1024) : queue_capacity(queueCapacity), cancelled(false) {}
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // First stage, function(emit) produces every item on a single worker
+    template <typename Out, typename F>
+    PipelineChannel<Out>& source(const std::string& name, F function) {
+        PipelineStageMetrics& metrics = addStage(name, 1);
+        PipelineChannel<Out>& output = addChannel<Out>(1);
+        workers.push_back([this, &metrics, &output, function]() mutable {
+            PipelineEmitter<Out> emit(output, metrics);
+            try {
+                timeCall(metrics, emit.blockedTime(), [&] { function(emit); });
+            } catch (...) {
+                fail();
+            }
+            output.producerFinished();
+        });
+        return output;
+    }
+
+    // Middle stage, function(item, emit) runs on workerCount threads and may emit zero or more items per input
+    template <typename In, typename Out, typename F>
+    PipelineChannel<Out>& stage(const std::string& name, size_t workerCount, PipelineChannel<In>& input, F function) {
+        workerCount = std::max<size_t>(1, workerCount);
+        PipelineStageMetrics& metrics = addStage(name, workerCount);
+        PipelineChannel<Out>& output = addChannel<Out>(workerCount);
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.push_back([this, &metrics, &input, &output, function]() mutable {
+                PipelineEmitter<Out> emit(output, metrics);
+                In item;
+                try {
+                    while (input.pop(item, metrics.starvedNs)) {
+                        metrics.itemsIn.fetch_add(1, std::memory_order_relaxed);
+                        timeCall(metrics, emit.blockedTime(), [&] { function(std::move(item), emit); });
+                    }
+                } catch (...) {
+                    fail();
+                }
+                output.producerFinished();
+            });
+        }
+        return output;
+    }
+
+    // Last stage, function(item) consumes items on workerCount threads
+    template <typename In, typename F>
+    void sink(const std::string& name, size_t workerCount, PipelineChannel<In>& input, F function) {
+        workerCount = std::max<size_t>(1, workerCount);
+        PipelineStageMetrics& metrics = addStage(name, workerCount);
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.push_back([this, &metrics, &input, function]() mutable {
+                In item;
+                const int64_t noBackpressure = 0;
+                try {
+                    while (input.pop(item, metrics.starvedNs)) {
+                        metrics.itemsIn.fetch_add(1, std::memory_order_relaxed);
+                        timeCall(metrics, noBackpressure, [&] { function(std::move(item)); });
+                    }
+                } catch (...) {
+                    fail();
+                }
+            });
+        }
+    }
+
+    // Start every stage, wait for the stream to drain, and rethrow the first stage failure
+    void run() {
+        std::vector<std::thread> threads;
+        threads.reserve(workers.size());
+        for (auto& worker : workers) {
+            threads.emplace_back(worker);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        workers.clear();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    std::vector<PipelineStageReport> report() const {
+        std::vector<PipelineStageReport> reports;
+        for (const auto& stage : stages) {
+            reports.push_back({stage.name, stage.workers, stage.itemsIn.load(), stage.itemsOut.load(),
+                               stage.busyNs.load() / 1e9, stage.starvedNs.load() / 1e9, stage.blockedNs.load() / 1e9});
+        }
+        return reports;
+    }
+
+    // Index of the stage with the highest busy time per worker, the one limiting throughput
+    size_t slowestStage() const {
+        size_t slowest = 0;
+        double slowestBusy = -1.0;
+        for (size_t i = 0; i < stages.size(); ++i) {
+            double busy = stages[i].busyNs.load() / 1e9 / static_cast<double>(stages[i].workers);
+            if (busy > slowestBusy) {
+                slowestBusy = busy;
+                slowest = i;
+            }
+        }
+        return slowest;
+    }
+
+    // One line per stage, the slowest stage highlighted
+    void printReport() const {
+        size_t slowest = slowestStage();
+        std::vector<PipelineStageReport> reports = report();
+        for (size_t i = 0; i < reports.size(); ++i) {
+            const auto& stage = reports[i];
+            std::cout << (i == slowest ? "\033[1;93m" : "\033[1m") << std::left << std::setw(10) << stage.name << std::right
+                      << " x" << stage.workers
+                      << "  in: " << stage.itemsIn << "  out: " << stage.itemsOut << std::fixed << std::setprecision(1)
+                      << "  busy: " << stage.busySeconds << "s  waiting: " << stage.starvedSeconds
+                      << "s  backpressure: " << stage.blockedSeconds << "s"
+                      << (i == slowest ? "  (slowest)" : "") << "\033[0;1m\n";
+        }
+    }
+};
+
+#endif // PIPELINE_H
@@ -1,6 +1,7 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 #include "headers.h"
+#include <pthread.h>
 
 
 // A global threadpool for async tasks with work-stealing scalable from 1 to 192 threads
@@ -182,6 +183,66 @@ private:
     // Atomic counter for tracking active tasks
     std::atomic<size_t> active_tasks;
 
+    // NUMA placement: CPUs each worker is pinned to, and steal victims on the same and on other nodes
+    std::vector<cpu_set_t> worker_cpus;
+    std::vector<bool> worker_pinned;
+    std::vector<std::vector<size_t>> local_victims;
+    std::vector<std::vector<size_t>> remote_victims;
+
+    // Startup barrier, workers allocate their own queue so its memory is first touched on their node
+    std::condition_variable startup_cv;
+    size_t queues_ready;
+
+    // Assign each worker to a node, filling the allowed CPUs in order so small pools stay on one socket
+    void planPlacement() {
+        const std::vector<int>& cpus = allowedCpus();
+        const std::vector<int>& cpuNodes = allowedCpuNodes();
+        std::vector<int> worker_nodes(num_threads);
+        std::set<int> nodes(cpuNodes.begin(), cpuNodes.end());
+
+        worker_cpus.resize(num_threads);
+        worker_pinned.assign(num_threads, nodes.size() > 1);
+        for (size_t i = 0; i < num_threads; ++i) {
+            worker_nodes[i] = cpuNodes[i % cpus.size()];
+
+            // Pin to the whole node rather than one core, workers block in I/O and mount syscalls
+            CPU_ZERO(&worker_cpus[i]);
+            for (size_t c = 0; c < cpus.size(); ++c) {
+                if (cpuNodes[c] == worker_nodes[i]) {
+                    CPU_SET(cpus[c], &worker_cpus[i]);
+                }
+            }
+        }
+
+        local_victims.resize(num_threads);
+        remote_victims.resize(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            for (size_t victim = 0; victim < num_threads; ++victim) {
+                if (victim == i) {
+                    continue;
+                }
+                (worker_nodes[victim] == worker_nodes[i] ? local_victims[i] : remote_victims[i]).push_back(victim);
+            }
+        }
+    }
+
+    // Steal a task, trying victims on our own node before crossing sockets
+    bool stealTask(size_t id, std::function<void()>& task, std::mt19937& rng) {
+        size_t steal_attempts = adaptiveStealAttempts();
+        for (const auto* victims : {&local_victims[id], &remote_victims[id]}) {
+            if (victims->empty()) {
+                continue;
+            }
+            std::uniform_int_distribution<size_t> dist(0, victims->size() - 1);
+            for (size_t i = 0; i < steal_attempts; ++i) {
+                if (queues[(*victims)[dist(rng)]]->steal(task)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
     // Private method to select a queue index based on a random strategy
     size_t selectQueue() {
         static thread_local std::mt19937 rng(std::random_device{}());
@@ -195,7 +256,19 @@ private:
     // Worker thread function
     void workerThread(size_t id) {
         std::mt19937 rng(id);
-        std::uniform_int_distribution<size_t> dist(0, num_threads - 1);
+
+        // Move to our node before allocating, so the queue's node pool is node-local
+        if (worker_pinned[id]) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &worker_cpus[id]);
+        }
+        auto queue = std::make_unique<LockFreeQueue<std::function<void()>>>(num_threads);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queues[id] = std::move(queue);
+            ++queues_ready;
+            startup_cv.notify_all();
+            startup_cv.wait(lock, [this] { return queues_ready == num_threads; });
+        }
 
         while (true) {
             std::function<void()> task;
@@ -203,14 +276,7 @@ private:
 
             // Attempt to steal tasks if the current queue is empty
             if (!gotTask) {
-                size_t steal_attempts = adaptiveStealAttempts();
-                for (size_t i = 0; i < steal_attempts; ++i) {
-                    size_t victim = dist(rng);
-                    if (victim != id && queues[victim]->steal(task)) {
-                        gotTask = true;
-                        break;
-                    }
-                }
+                gotTask = stealTask(id, task, rng);
             }
 
             // Execute the task if obtained, otherwise wait
@@ -246,14 +312,16 @@ private:
 public:
     // Constructor to initialize the thread pool with a specified number of threads
     explicit ThreadPool(size_t numThreads)
-        : stop(false), next_queue(0), num_threads(numThreads), active_tasks(0) {
-        queues.reserve(numThreads);
-        for (size_t i = 0; i < numThreads; ++i) {
-            queues.emplace_back(std::make_unique<LockFreeQueue<std::function<void()>>>(numThreads));
-        }
+        : stop(false), next_queue(0), num_threads(numThreads), active_tasks(0), queues_ready(0) {
+        planPlacement();
+        queues.resize(numThreads);
         for (size_t i = 0; i < numThreads; ++i) {
             workers.emplace_back(&ThreadPool::workerThread, this, i);
         }
+
+        // Tasks may be enqueued to any queue, wait until every worker has created its own
+        std::unique_lock<std::mutex> lock(mutex);
+        startup_cv.wait(lock, [this] { return queues_ready == num_threads; });
     }
 
     // Enqueue method to submit a task to the thread pool
@@ -272,6 +340,13 @@ public:
         return res;
     }
 
+    // Post a fire-and-forget task, used to resume coroutines without a future per step
+    void post(std::function<void()> task) {
+        size_t index = selectQueue();
+        queues[index]->enqueue(std::move(task));
+        cv.notify_one();
+    }
+
     // Destructor to stop all threads and clean up resources
     ~ThreadPool() {
         stop.value.store(true, std::memory_order_release);
@@ -293,4 +368,169 @@ public:
     }
 };
 
+// AIMD controller for the number of in-flight operations of one class, latency inflation counts as congestion
+class ConcurrencyController {
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Current in-flight limit and its bounds
+    double limit;
+    const double min_limit;
+    const double max_limit;
+    size_t in_flight;
+
+    // Measurement window, roughly one round of the current limit
+    std::chrono::steady_clock::time_point window_start;
+    size_t window_completions;
+    double window_latency;
+
+    // State of the previous window
+    double previous_throughput;
+    double base_latency;     // Lowest window latency seen, the uncongested reference
+    bool last_increased;
+
+    // Adjust the limit at the end of each window, called with the mutex held
+    void recordCompletion(double latency) {
+        ++window_completions;
+        window_latency += latency;
+        if (window_completions < std::max<size_t>(4, static_cast<size_t>(limit))) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::max(std::chrono::duration<double>(now - window_start).count(), 1e-6);
+        double throughput = window_completions / elapsed;
+        double average_latency = window_latency / window_completions;
+        if (base_latency == 0.0 || average_latency < base_latency) {
+            base_latency = average_latency;
+        }
+
+        // Congested when operations queue up in the device or the last increase cost throughput
+        bool congested = average_latency > base_latency * 2.0 ||
+                         (last_increased && throughput < previous_throughput * 0.9);
+        if (congested) {
+            limit = std::max(min_limit, limit * 0.75);
+            last_increased = false;
+        } else {
+            last_increased = limit < max_limit;
+            limit = std::min(max_limit, limit + 1.0);
+        }
+
+        previous_throughput = throughput;
+        window_start = now;
+        window_completions = 0;
+        window_latency = 0.0;
+        cv.notify_all();
+    }
+
+public:
+    ConcurrencyController(size_t initial_limit, size_t maximum_limit)
+        : limit(static_cast<double>(std::max<size_t>(1, std::min(initial_limit, maximum_limit)))),
+          min_limit(1.0),
+          max_limit(static_cast<double>(std::max<size_t>(1, maximum_limit))),
+          in_flight(0),
+          window_start(std::chrono::steady_clock::now()),
+          window_completions(0),
+          window_latency(0.0),
+          previous_throughput(0.0),
+          base_latency(0.0),
+          last_increased(false) {}
+
+    // Wait until another operation may start
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return in_flight < static_cast<size_t>(limit); });
+
+        // Idle time between operations must not count against throughput
+        if (in_flight == 0) {
+            window_start = std::chrono::steady_clock::now();
+            window_completions = 0;
+            window_latency = 0.0;
+        }
+        ++in_flight;
+    }
+
+    // Take a slot only if one is free right now, instead of waiting for it
+    bool tryAcquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (in_flight >= static_cast<size_t>(limit)) {
+            return false;
+        }
+        if (in_flight == 0) {
+            window_start = std::chrono::steady_clock::now();
+            window_completions = 0;
+            window_latency = 0.0;
+        }
+        ++in_flight;
+        return true;
+    }
+
+    // Report a finished operation and its latency in seconds
+    void release(double latency) {
+        std::lock_guard<std::mutex> lock(mutex);
+        --in_flight;
+        recordCompletion(latency);
+        cv.notify_one();
+    }
+
+    // Current in-flight limit
+    size_t currentLimit() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<size_t>(limit);
+    }
+
+    // Holds one in-flight slot for the lifetime of an operation
+    class Slot {
+    private:
+        ConcurrencyController& controller;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit Slot(ConcurrencyController& owner) : controller(owner) {
+            controller.acquire();
+            start = std::chrono::steady_clock::now();
+        }
+
+        // Takes over a slot already taken with tryAcquire()
+        Slot(ConcurrencyController& owner, std::adopt_lock_t) : controller(owner), start(std::chrono::steady_clock::now()) {}
+
+        ~Slot() {
+            controller.release(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+    };
+};
+
+
+// Upper bound for I/O-bound pools, which may run well above the CPU count (io_concurrency_max)
+inline size_t ioConcurrencyMax() {
+    static const size_t maximum = static_cast<size_t>(std::max<long>(maxThreads, configNumber("io_concurrency_max", 64)));
+    return maximum;
+}
+
+
+// Process-wide controller of an operation class, so the limit learned by one operation carries over to the next
+inline ConcurrencyController& concurrencyControllerFor(const std::string& operation_class) {
+    static std::mutex registry_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<ConcurrencyController>> controllers;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto& controller = controllers[operation_class];
+    if (!controller) {
+        // Start at the CPU count, which is what every pool used before
+        controller = std::make_unique<ConcurrencyController>(maxThreads, ioConcurrencyMax());
+    }
+    return *controller;
+}
+
+
+// Worker count of a pool whose tasks each hold a slot of controller: its current limit and one more, so an increase learned
+// during the batch can take effect, rather than io_concurrency_max workers that would mostly block on their slots
+inline size_t ioPoolSize(ConcurrencyController& controller, size_t items) {
+    return std::max<size_t>(1, std::min({items, controller.currentLimit() + 1, ioConcurrencyMax()}));
+}
+
 #endif // THREAD_POOL_H